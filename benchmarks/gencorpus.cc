@@ -0,0 +1,227 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+// Deterministic synthetic training corpora, for measuring training speed
+// without downloading data. Words follow a Zipf distribution over a fixed
+// vocabulary; lines may start with a weight (for -weighted) and with a
+// label whose lines favour words of their own, so that supervised models
+// have something to learn. Only std::minstd_rand, whose output the standard
+// fixes, is used, so a seed gives the same file on every platform.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Options {
+  std::string output = "-";
+  int64_t tokens = 10000000;
+  int32_t vocab = 100000;
+  double zipf = 1.0;
+  int32_t minLine = 10;
+  int32_t maxLine = 30;
+  int32_t labels = 0;
+  std::string labelPrefix = "__label__";
+  double topic = 0.3;
+  bool weights = false;
+  uint32_t seed = 1;
+};
+
+void printUsage() {
+  std::cerr
+      << "usage: fasttext-gencorpus <args>\n\n"
+      << "  -output       output file, - for stdout [-]\n"
+      << "  -tokens       number of words to write [10000000]\n"
+      << "  -vocab        vocabulary size [100000]\n"
+      << "  -zipf         exponent of the word frequencies [1.0]\n"
+      << "  -minLine      minimum words per line [10]\n"
+      << "  -maxLine      maximum words per line [30]\n"
+      << "  -labels       number of labels, one per line, 0 for none [0]\n"
+      << "  -labelPrefix  labels prefix [__label__]\n"
+      << "  -topic        share of the words drawn for the label [0.3]\n"
+      << "  -weights      start every line with a weight in [0.5, 2)\n"
+      << "  -seed         random seed [1]\n"
+      << std::endl;
+}
+
+Options parseOptions(int argc, char** argv) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    const std::string name(argv[i]);
+    if (name == "-h" || name == "-help" || name == "--help") {
+      printUsage();
+      exit(EXIT_SUCCESS);
+    }
+    if (name == "-weights") {
+      options.weights = true;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      std::cerr << name << " is missing an argument" << std::endl;
+      printUsage();
+      exit(EXIT_FAILURE);
+    }
+    const std::string value(argv[++i]);
+    if (name == "-output") {
+      options.output = value;
+    } else if (name == "-tokens") {
+      options.tokens = std::stoll(value);
+    } else if (name == "-vocab") {
+      options.vocab = std::stoi(value);
+    } else if (name == "-zipf") {
+      options.zipf = std::stod(value);
+    } else if (name == "-minLine") {
+      options.minLine = std::stoi(value);
+    } else if (name == "-maxLine") {
+      options.maxLine = std::stoi(value);
+    } else if (name == "-labels") {
+      options.labels = std::stoi(value);
+    } else if (name == "-labelPrefix") {
+      options.labelPrefix = value;
+    } else if (name == "-topic") {
+      options.topic = std::stod(value);
+    } else if (name == "-seed") {
+      options.seed = std::stoul(value);
+    } else {
+      std::cerr << "Unknown argument: " << name << std::endl;
+      printUsage();
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (options.vocab <= 0 || options.minLine <= 0 ||
+      options.maxLine < options.minLine || options.labels < 0) {
+    std::cerr << "Invalid vocabulary, line length or label count" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  return options;
+}
+
+class Random {
+ public:
+  explicit Random(uint32_t seed) : rng_(seed) {}
+
+  // Uniform in [0, 1).
+  double uniform() {
+    return double(rng_() - rng_.min()) / (double(rng_.max() - rng_.min()) + 1);
+  }
+
+  // Uniform in [lo, hi].
+  int32_t uniform(int32_t lo, int32_t hi) {
+    return lo + std::min<int32_t>(hi - lo, uniform() * (hi - lo + 1));
+  }
+
+ private:
+  std::minstd_rand rng_;
+};
+
+// Rank i (from 0) is drawn with probability proportional to 1 / (i + 1)^s.
+class Zipf {
+ public:
+  Zipf(int32_t n, double s) : cdf_(n) {
+    double total = 0.0;
+    for (int32_t i = 0; i < n; i++) {
+      total += std::pow(i + 1, -s);
+      cdf_[i] = total;
+    }
+  }
+
+  int32_t sample(Random& random) const {
+    const double u = random.uniform() * cdf_.back();
+    const auto it = std::upper_bound(cdf_.begin(), cdf_.end(), u);
+    return std::min<int32_t>(it - cdf_.begin(), cdf_.size() - 1);
+  }
+
+ private:
+  std::vector<double> cdf_;
+};
+
+// Distinct lowercase words of 3 to 12 letters: the rank in base 26 after
+// random letters.
+std::vector<std::string> makeVocab(int32_t n, Random& random) {
+  std::vector<std::string> vocab(n);
+  for (int32_t i = 0; i < n; i++) {
+    std::string suffix;
+    for (int32_t r = i; r > 0 || suffix.empty(); r /= 26) {
+      suffix.push_back('a' + r % 26);
+    }
+    std::string& word = vocab[i];
+    const int32_t length = random.uniform(3, 12);
+    while (int32_t(word.size() + suffix.size()) < length) {
+      word.push_back('a' + random.uniform(0, 25));
+    }
+    word += suffix;
+  }
+  return vocab;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const Options options = parseOptions(argc, argv);
+  Random random(options.seed);
+  const std::vector<std::string> vocab = makeVocab(options.vocab, random);
+  const Zipf words(options.vocab, options.zipf);
+  FILE* out = options.output == "-" ? stdout
+                                    : fopen(options.output.c_str(), "w");
+  if (out == nullptr) {
+    std::cerr << options.output << " cannot be opened for writing!"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+  int64_t ntokens = 0, nlines = 0;
+  std::string line;
+  while (ntokens < options.tokens) {
+    line.clear();
+    if (options.weights) {
+      char weight[16];
+      snprintf(weight, sizeof(weight), "%.3f ", 0.5 + 1.5 * random.uniform());
+      line += weight;
+    }
+    int32_t label = -1;
+    if (options.labels > 0) {
+      label = random.uniform(0, options.labels - 1);
+      line += options.labelPrefix + std::to_string(label);
+    }
+    const int64_t length = std::min<int64_t>(
+        random.uniform(options.minLine, options.maxLine),
+        options.tokens - ntokens);
+    for (int64_t i = 0; i < length; i++) {
+      int64_t rank = words.sample(random);
+      // The words of a label are the whole vocabulary, shifted by a label
+      // specific offset, so that their frequencies stay Zipfian.
+      if (label >= 0 && random.uniform() < options.topic) {
+        rank = (rank + int64_t(label) * options.vocab / options.labels) %
+            options.vocab;
+      }
+      if (!line.empty() && line.back() != ' ') {
+        line.push_back(' ');
+      }
+      line += vocab[rank];
+    }
+    line.push_back('\n');
+    fwrite(line.data(), 1, line.size(), out);
+    ntokens += length;
+    nlines++;
+  }
+  if (out != stdout) {
+    fclose(out);
+  }
+  std::cerr << "words " << ntokens << " labels "
+            << (options.labels > 0 ? nlines : 0) << " lines " << nlines
+            << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,422 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+// Inference latency under concurrent load. Loads models (fp32 or quantized)
+// and replays the lines of an input file through FastText::predict,
+// getWordVector and getSentenceVector from several threads at once, timing
+// every call. The times go to log-linear histograms, as in HdrHistogram,
+// and the tail percentiles and the throughput of each run are printed as
+// one JSON object per line (or as CSV).
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "args.h"
+#include "backend.h"
+#include "fasttext.h"
+#include "kernels.h"
+#include "vector.h"
+
+using namespace fasttext;
+
+namespace {
+
+struct Options {
+  std::vector<std::string> models;
+  std::string input;
+  std::vector<std::string> calls = {"predict", "word", "sentence"};
+  std::vector<int32_t> threads = {1};
+  int32_t k = 1;
+  float threshold = 0.0;
+  double duration = 2.0;
+  double warmup = 0.5;
+  std::string format = "json";
+};
+
+void printUsage() {
+  std::cerr
+      << "usage: fasttext-latency <args>\n\n"
+      << "  -model       comma-separated model files (.bin or .ftz)\n"
+      << "  -input       file whose lines are replayed\n"
+      << "  -calls       comma-separated calls among predict, word and\n"
+      << "               sentence [predict,word,sentence]\n"
+      << "  -threads     comma-separated thread counts [1]\n"
+      << "  -k           labels predicted per line [1]\n"
+      << "  -threshold   minimum probability of the predicted labels [0.0]\n"
+      << "  -duration    seconds measured per result [2.0]\n"
+      << "  -warmup      seconds run before measuring [0.5]\n"
+      << "  -format      json or csv [json]\n"
+      << std::endl;
+}
+
+std::vector<std::string> split(const std::string& value) {
+  std::vector<std::string> items;
+  std::istringstream in(value);
+  std::string item;
+  while (std::getline(in, item, ',')) {
+    if (!item.empty()) {
+      items.push_back(item);
+    }
+  }
+  return items;
+}
+
+std::vector<int32_t> parseList(const std::string& value) {
+  std::vector<int32_t> list;
+  for (const auto& item : split(value)) {
+    const int32_t n = std::stoi(item);
+    if (n <= 0) {
+      throw std::invalid_argument("List values must be positive: " + value);
+    }
+    list.push_back(n);
+  }
+  return list;
+}
+
+Options parseOptions(int argc, char** argv) {
+  Options options;
+  for (int i = 1; i < argc; i += 2) {
+    const std::string name(argv[i]);
+    if (name == "-h" || name == "-help" || name == "--help") {
+      printUsage();
+      exit(EXIT_SUCCESS);
+    }
+    if (i + 1 >= argc) {
+      std::cerr << name << " is missing an argument" << std::endl;
+      printUsage();
+      exit(EXIT_FAILURE);
+    }
+    const std::string value(argv[i + 1]);
+    if (name == "-model") {
+      options.models = split(value);
+    } else if (name == "-input") {
+      options.input = value;
+    } else if (name == "-calls") {
+      options.calls = split(value);
+    } else if (name == "-threads") {
+      options.threads = parseList(value);
+    } else if (name == "-k") {
+      options.k = std::stoi(value);
+    } else if (name == "-threshold") {
+      options.threshold = std::stof(value);
+    } else if (name == "-duration") {
+      options.duration = std::stod(value);
+    } else if (name == "-warmup") {
+      options.warmup = std::stod(value);
+    } else if (name == "-format" && (value == "json" || value == "csv")) {
+      options.format = value;
+    } else {
+      std::cerr << "Unknown argument: " << name << " " << value << std::endl;
+      printUsage();
+      exit(EXIT_FAILURE);
+    }
+  }
+  for (const auto& call : options.calls) {
+    if (call != "predict" && call != "word" && call != "sentence") {
+      std::cerr << "Unknown call: " << call << std::endl;
+      printUsage();
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (options.models.empty() || options.input.empty()) {
+    std::cerr << "-model and -input are required" << std::endl;
+    printUsage();
+    exit(EXIT_FAILURE);
+  }
+  return options;
+}
+
+// Counts of nanosecond values in log-linear buckets: values below
+// 2^(PRECISION + 1) have a bucket each, and every later power of two is
+// split into 2^PRECISION buckets, so that a bucket is never wider than
+// 1/128 of its values. Recording is a few instructions and no allocation.
+class Histogram {
+ public:
+  static constexpr int32_t PRECISION = 7;
+
+  Histogram()
+      : counts_((65 - PRECISION) << PRECISION, 0),
+        count_(0),
+        sum_(0),
+        max_(0) {}
+
+  void record(uint64_t value) {
+    counts_[index(value)]++;
+    count_++;
+    sum_ += value;
+    max_ = std::max(max_, value);
+  }
+
+  void merge(const Histogram& other) {
+    for (std::size_t i = 0; i < counts_.size(); i++) {
+      counts_[i] += other.counts_[i];
+    }
+    count_ += other.count_;
+    sum_ += other.sum_;
+    max_ = std::max(max_, other.max_);
+  }
+
+  uint64_t count() const {
+    return count_;
+  }
+
+  uint64_t max() const {
+    return max_;
+  }
+
+  double mean() const {
+    return count_ > 0 ? double(sum_) / count_ : 0.0;
+  }
+
+  // The highest value of the bucket that holds the q-th percentile, so
+  // that percentiles are never under-reported.
+  uint64_t percentile(double q) const {
+    if (count_ == 0) {
+      return 0;
+    }
+    const uint64_t rank = std::max<uint64_t>(
+        1, uint64_t(std::ceil(q / 100.0 * count_)));
+    uint64_t seen = 0;
+    for (std::size_t i = 0; i < counts_.size(); i++) {
+      seen += counts_[i];
+      if (seen >= rank) {
+        return std::min(lowest(i + 1) - 1, max_);
+      }
+    }
+    return max_;
+  }
+
+ private:
+  std::vector<uint64_t> counts_;
+  uint64_t count_;
+  uint64_t sum_;
+  uint64_t max_;
+
+  static std::size_t index(uint64_t value) {
+    const int32_t msb = 63 - __builtin_clzll(value | 1);
+    if (msb <= PRECISION) {
+      return value;
+    }
+    const int32_t shift = msb - PRECISION;
+    return (std::size_t(shift) << PRECISION) + (value >> shift);
+  }
+
+  static uint64_t lowest(std::size_t index) {
+    if (index < (std::size_t(2) << PRECISION)) {
+      return index;
+    }
+    const int32_t shift = (index >> PRECISION) - 1;
+    return uint64_t(index - (std::size_t(shift) << PRECISION)) << shift;
+  }
+};
+
+typedef std::chrono::steady_clock Clock;
+
+double seconds(Clock::duration d) {
+  return std::chrono::duration<double>(d).count();
+}
+
+// Per-thread state of one call, that is reused across calls so that only
+// the work of the call itself is timed.
+class Caller {
+ public:
+  Caller(FastText& fasttext, const Options& options)
+      : fasttext_(fasttext),
+        options_(options),
+        vector_(fasttext.getDimension()) {}
+
+  void call(const std::string& name, const std::string& line) {
+    if (name == "predict") {
+      std::istringstream in(line);
+      fasttext_.predict(in, options_.k, predictions_, options_.threshold);
+    } else if (name == "word") {
+      fasttext_.getWordVector(vector_, line);
+    } else {
+      std::istringstream in(line);
+      fasttext_.getSentenceVector(in, vector_);
+    }
+  }
+
+ private:
+  FastText& fasttext_;
+  const Options& options_;
+  Vector vector_;
+  std::vector<std::pair<float, std::string>> predictions_;
+};
+
+struct Result {
+  Histogram histogram;
+  double seconds;
+};
+
+// Closed-loop load: every thread issues one call after the other, starting
+// from its own place in the inputs and cycling through them, until the
+// warmup and then the measurement time are over. Only the calls made during
+// the measurement are recorded.
+Result replay(FastText& fasttext, const Options& options,
+              const std::string& name, const std::vector<std::string>& inputs,
+              int32_t nthreads) {
+  std::vector<Histogram> histograms(nthreads);
+  std::atomic<int32_t> ready(0);
+  std::atomic<bool> go(false), measuring(false), stop(false);
+  std::vector<std::thread> workers;
+  for (int32_t t = 0; t < nthreads; t++) {
+    workers.push_back(std::thread([&, t]() {
+      Caller caller(fasttext, options);
+      std::size_t i = inputs.size() * t / nthreads;
+      ready++;
+      while (!go) {
+      }
+      while (!stop) {
+        const bool recorded = measuring;
+        const auto start = Clock::now();
+        caller.call(name, inputs[i]);
+        const auto end = Clock::now();
+        if (recorded) {
+          histograms[t].record(
+              std::chrono::duration_cast<std::chrono::nanoseconds>(
+                  end - start)
+                  .count());
+        }
+        if (++i == inputs.size()) {
+          i = 0;
+        }
+      }
+    }));
+  }
+  while (ready < nthreads) {
+  }
+  go = true;
+  std::this_thread::sleep_for(std::chrono::duration<double>(options.warmup));
+  const auto start = Clock::now();
+  measuring = true;
+  std::this_thread::sleep_for(std::chrono::duration<double>(options.duration));
+  measuring = false;
+  const auto end = Clock::now();
+  stop = true;
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  Result result;
+  for (const auto& histogram : histograms) {
+    result.histogram.merge(histogram);
+  }
+  result.seconds = seconds(end - start);
+  return result;
+}
+
+class Reporter {
+ public:
+  explicit Reporter(const Options& options)
+      : options_(options), header_(false) {}
+
+  void report(const std::string& model, bool quantized,
+              const std::string& name, int32_t nthreads,
+              const Result& result) {
+    const Histogram& h = result.histogram;
+    const double callsPerSec = h.count() / result.seconds;
+    const std::string isa = kernels::isaName(kernels::activeIsa());
+    std::cout << std::setprecision(6);
+    if (options_.format == "csv") {
+      if (!header_) {
+        std::cout << "model,quantized,call,threads,calls,calls_per_sec,"
+                  << "mean_ns,p50_ns,p90_ns,p99_ns,p999_ns,max_ns,isa,backend"
+                  << std::endl;
+        header_ = true;
+      }
+      std::cout << model << "," << quantized << "," << name << ","
+                << nthreads << "," << h.count() << "," << callsPerSec << ","
+                << h.mean() << "," << h.percentile(50) << ","
+                << h.percentile(90) << "," << h.percentile(99) << ","
+                << h.percentile(99.9) << "," << h.max() << "," << isa << ","
+                << backend::name() << std::endl;
+      return;
+    }
+    std::cout << "{\"model\":\"" << model << "\""
+              << ",\"quantized\":" << (quantized ? "true" : "false")
+              << ",\"call\":\"" << name << "\""
+              << ",\"threads\":" << nthreads << ",\"calls\":" << h.count()
+              << ",\"calls_per_sec\":" << callsPerSec
+              << ",\"mean_ns\":" << h.mean()
+              << ",\"p50_ns\":" << h.percentile(50)
+              << ",\"p90_ns\":" << h.percentile(90)
+              << ",\"p99_ns\":" << h.percentile(99)
+              << ",\"p999_ns\":" << h.percentile(99.9)
+              << ",\"max_ns\":" << h.max() << ",\"isa\":\"" << isa
+              << "\",\"backend\":\"" << backend::name() << "\"}" << std::endl;
+  }
+
+ private:
+  const Options& options_;
+  bool header_;
+};
+
+// Lines without their end, and the words of all lines, for word calls.
+void readInputs(const std::string& filename, std::vector<std::string>& lines,
+                std::vector<std::string>& words) {
+  std::ifstream in(filename);
+  if (!in.is_open()) {
+    throw std::invalid_argument(filename + " cannot be opened for reading!");
+  }
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream iss(line);
+    std::string word;
+    while (iss >> word) {
+      words.push_back(word);
+    }
+    if (!line.empty()) {
+      lines.push_back(line);
+    }
+  }
+  if (lines.empty()) {
+    throw std::invalid_argument(filename + " has no input lines!");
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const Options options = parseOptions(argc, argv);
+  std::vector<std::string> lines, words;
+  readInputs(options.input, lines, words);
+  Reporter reporter(options);
+  for (const auto& model : options.models) {
+    FastText fasttext;
+    fasttext.loadModel(model);
+    const bool supervised = fasttext.getArgs().model == model_name::sup;
+    for (const auto& name : options.calls) {
+      if (name == "predict" && !supervised) {
+        std::cerr << model << ": predict needs a supervised model, skipped"
+                  << std::endl;
+        continue;
+      }
+      const std::vector<std::string>& inputs = name == "word" ? words : lines;
+      for (int32_t nthreads : options.threads) {
+        const Result result =
+            replay(fasttext, options, name, inputs, nthreads);
+        reporter.report(model, fasttext.isQuant(), name, nthreads, result);
+      }
+    }
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,624 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+// Microbenchmarks of the row kernels, quantization, dictionary lookups and
+// prediction, swept over dimensions, label counts and thread counts. Every
+// result is printed as one JSON object per line (or as CSV), so that runs
+// on different commits or machines can be compared by a script.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "args.h"
+#include "backend.h"
+#include "dictionary.h"
+#include "kernels.h"
+#include "matrix.h"
+#include "model.h"
+#include "productquantizer.h"
+#include "qmatrix.h"
+#include "vector.h"
+
+using namespace fasttext;
+
+namespace {
+
+// Row indices are drawn from a table of this many (a power of two).
+constexpr int64_t NINDICES = 1 << 16;
+constexpr int32_t VOCAB_SIZE = 100000;
+constexpr int32_t LINE_LENGTH = 20;
+constexpr char LABEL[] = "__label__";
+
+struct Options {
+  std::vector<int32_t> dims = {50, 100, 300};
+  std::vector<int32_t> labels = {10, 1000, 100000};
+  std::vector<int32_t> threads = {1};
+  int64_t rows = 100000;
+  int32_t pqRows = 4096;
+  double minTime = 0.2;
+  int32_t repeat = 3;
+  std::string filter;
+  std::string format = "json";
+};
+
+typedef std::vector<std::pair<std::string, int64_t>> Params;
+
+// Runs iterations operations for worker thread; all workers run at once.
+typedef std::function<void(int32_t, int64_t)> Body;
+
+void printUsage() {
+  std::cerr
+      << "usage: fasttext-bench <args>\n\n"
+      << "  -dims        comma-separated dimensions [50,100,300]\n"
+      << "  -labels      comma-separated label counts [10,1000,100000]\n"
+      << "  -threads     comma-separated thread counts [1]\n"
+      << "  -rows        rows of the matrices looked up [100000]\n"
+      << "  -pqRows      rows to quantize [4096]\n"
+      << "  -minTime     minimum seconds per measurement [0.2]\n"
+      << "  -repeat      measurements per result [3]\n"
+      << "  -filter      only benchmarks whose name contains this []\n"
+      << "  -format      json or csv [json]\n"
+      << std::endl;
+}
+
+std::vector<int32_t> parseList(const std::string& value) {
+  std::vector<int32_t> list;
+  std::istringstream in(value);
+  std::string item;
+  while (std::getline(in, item, ',')) {
+    const int32_t n = std::stoi(item);
+    if (n <= 0) {
+      throw std::invalid_argument("List values must be positive: " + value);
+    }
+    list.push_back(n);
+  }
+  return list;
+}
+
+Options parseOptions(int argc, char** argv) {
+  Options options;
+  for (int i = 1; i < argc; i += 2) {
+    const std::string name(argv[i]);
+    if (name == "-h" || name == "-help" || name == "--help") {
+      printUsage();
+      exit(EXIT_SUCCESS);
+    }
+    if (i + 1 >= argc) {
+      std::cerr << name << " is missing an argument" << std::endl;
+      printUsage();
+      exit(EXIT_FAILURE);
+    }
+    const std::string value(argv[i + 1]);
+    if (name == "-dims") {
+      options.dims = parseList(value);
+    } else if (name == "-labels") {
+      options.labels = parseList(value);
+    } else if (name == "-threads") {
+      options.threads = parseList(value);
+    } else if (name == "-rows") {
+      options.rows = std::stoll(value);
+    } else if (name == "-pqRows") {
+      options.pqRows = std::stoi(value);
+    } else if (name == "-minTime") {
+      options.minTime = std::stod(value);
+    } else if (name == "-repeat") {
+      options.repeat = std::max(1, std::stoi(value));
+    } else if (name == "-filter") {
+      options.filter = value;
+    } else if (name == "-format" && (value == "json" || value == "csv")) {
+      options.format = value;
+    } else {
+      std::cerr << "Unknown argument: " << name << " " << value << std::endl;
+      printUsage();
+      exit(EXIT_FAILURE);
+    }
+  }
+  return options;
+}
+
+double now() {
+  return std::chrono::duration<double>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Wall time of iterations calls on each of nthreads workers, started
+// together once they all exist.
+double timeThreads(const Body& body, int32_t nthreads, int64_t iterations) {
+  std::atomic<int32_t> ready(0);
+  std::atomic<bool> go(false);
+  std::vector<std::thread> workers;
+  for (int32_t t = 0; t < nthreads; t++) {
+    workers.push_back(std::thread([&, t]() {
+      ready++;
+      while (!go) {
+      }
+      body(t, iterations);
+    }));
+  }
+  while (ready < nthreads) {
+  }
+  const double start = now();
+  go = true;
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  return now() - start;
+}
+
+class Runner {
+ public:
+  explicit Runner(const Options& options) : options_(options), header_(false) {}
+
+  bool wanted(const std::string& name) const {
+    return name.find(options_.filter) != std::string::npos;
+  }
+
+  bool wantedAny(const std::vector<std::string>& names) const {
+    for (const auto& name : names) {
+      if (wanted(name)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // The iteration count is doubled until one worker alone takes minTime;
+  // every thread count then runs that many per worker, so the time per
+  // operation shows how well the operation scales.
+  void run(const std::string& name, const Params& params, const Body& body) {
+    int64_t iterations = 1;
+    while (timeThreads(body, 1, iterations) < options_.minTime) {
+      iterations *= 2;
+    }
+    for (int32_t nthreads : options_.threads) {
+      std::vector<double> times;
+      for (int32_t r = 0; r < options_.repeat; r++) {
+        times.push_back(timeThreads(body, nthreads, iterations));
+      }
+      report(name, params, nthreads, nthreads, iterations, times);
+    }
+  }
+
+  // For operations that take their own thread count, run once per count;
+  // each run does iterations operations.
+  void runThreaded(const std::string& name, const Params& params,
+                   const std::function<void(int32_t)>& body,
+                   int64_t iterations = 1) {
+    for (int32_t nthreads : options_.threads) {
+      std::vector<double> times;
+      for (int32_t r = 0; r < options_.repeat; r++) {
+        const double start = now();
+        body(nthreads);
+        times.push_back(now() - start);
+      }
+      report(name, params, nthreads, 1, iterations, times);
+    }
+  }
+
+ private:
+  const Options& options_;
+  bool header_;
+
+  // Each of workers threads ran iterations operations.
+  void report(const std::string& name, const Params& params, int32_t nthreads,
+              int32_t workers, int64_t iterations, std::vector<double> times) {
+    std::sort(times.begin(), times.end());
+    const double median = times[times.size() / 2];
+    const double nsPerOp = 1e9 * median / iterations;
+    const double nsPerOpMin = 1e9 * times[0] / iterations;
+    const double opsPerSec = workers * iterations / median;
+    const std::string isa = kernels::isaName(kernels::activeIsa());
+    std::cout << std::setprecision(6);
+    if (options_.format == "csv") {
+      if (!header_) {
+        std::cout << "benchmark,params,threads,iterations,ns_per_op,"
+                  << "ns_per_op_min,ops_per_sec,isa,backend" << std::endl;
+        header_ = true;
+      }
+      std::cout << name << ",";
+      for (std::size_t i = 0; i < params.size(); i++) {
+        std::cout << (i > 0 ? ";" : "") << params[i].first << "="
+                  << params[i].second;
+      }
+      std::cout << "," << nthreads << "," << iterations << "," << nsPerOp
+                << "," << nsPerOpMin << "," << opsPerSec << "," << isa << ","
+                << backend::name() << std::endl;
+      return;
+    }
+    std::cout << "{\"benchmark\":\"" << name << "\"";
+    for (const auto& param : params) {
+      std::cout << ",\"" << param.first << "\":" << param.second;
+    }
+    std::cout << ",\"threads\":" << nthreads
+              << ",\"iterations\":" << iterations
+              << ",\"ns_per_op\":" << nsPerOp
+              << ",\"ns_per_op_min\":" << nsPerOpMin
+              << ",\"ops_per_sec\":" << opsPerSec << ",\"isa\":\"" << isa
+              << "\",\"backend\":\"" << backend::name() << "\"}" << std::endl;
+  }
+};
+
+// One slot per worker, a cache line apart, that results are summed into so
+// that the compiler cannot drop the work.
+class Sink {
+ public:
+  explicit Sink(int32_t nthreads) : values_(16 * nthreads, 0.0f) {}
+  float& operator[](int32_t thread) { return values_[16 * thread]; }
+
+ private:
+  std::vector<float> values_;
+};
+
+int32_t maxThreads(const Options& options) {
+  return *std::max_element(options.threads.begin(), options.threads.end());
+}
+
+std::vector<int64_t> randomIndices(int64_t n, uint32_t seed) {
+  std::minstd_rand rng(seed);
+  std::uniform_int_distribution<int64_t> uniform(0, n - 1);
+  std::vector<int64_t> indices(NINDICES);
+  for (auto& index : indices) {
+    index = uniform(rng);
+  }
+  return indices;
+}
+
+typedef std::vector<std::unique_ptr<Vector>> Vectors;
+
+// One vector per worker.
+Vectors randomVectors(int32_t count, int64_t dim) {
+  std::minstd_rand rng(dim);
+  std::uniform_real_distribution<float> uniform(-1, 1);
+  Vectors vectors;
+  for (int32_t i = 0; i < count; i++) {
+    vectors.emplace_back(new Vector(dim));
+    for (int64_t j = 0; j < dim; j++) {
+      (*vectors.back())[j] = uniform(rng);
+    }
+  }
+  return vectors;
+}
+
+void benchMatrix(Runner& runner, const Options& options, int32_t dim) {
+  if (!runner.wantedAny(
+          {"matrix.dotRow", "matrix.addRow", "vector.addRow"})) {
+    return;
+  }
+  const int32_t nthreads = maxThreads(options);
+  Matrix matrix(options.rows, dim);
+  matrix.uniform(1.0 / dim);
+  const std::vector<int64_t> indices = randomIndices(options.rows, dim);
+  Vectors vectors = randomVectors(nthreads, dim);
+  Sink sink(nthreads);
+  const Params params = {{"dim", dim}, {"rows", options.rows}};
+  if (runner.wanted("matrix.dotRow")) {
+    runner.run("matrix.dotRow", params, [&](int32_t t, int64_t n) {
+      float s = 0.0;
+      for (int64_t i = 0; i < n; i++) {
+        s += matrix.dotRow(*vectors[t], indices[i & (NINDICES - 1)]);
+      }
+      sink[t] += s;
+    });
+  }
+  if (runner.wanted("matrix.addRow")) {
+    runner.run("matrix.addRow", params, [&](int32_t t, int64_t n) {
+      for (int64_t i = 0; i < n; i++) {
+        matrix.addRow(*vectors[t], indices[i & (NINDICES - 1)], 1e-6);
+      }
+    });
+  }
+  if (runner.wanted("vector.addRow")) {
+    runner.run("vector.addRow", params, [&](int32_t t, int64_t n) {
+      for (int64_t i = 0; i < n; i++) {
+        vectors[t]->addRow(matrix, indices[i & (NINDICES - 1)]);
+      }
+      sink[t] += (*vectors[t])[0];
+    });
+  }
+}
+
+void benchVectorMul(Runner& runner, const Options& options, int32_t dim,
+                    int32_t nlabels) {
+  if (!runner.wanted("vector.mul")) {
+    return;
+  }
+  const int32_t nthreads = maxThreads(options);
+  Matrix matrix(nlabels, dim);
+  matrix.uniform(1.0 / dim);
+  Vectors hidden = randomVectors(nthreads, dim);
+  Vectors outputs = randomVectors(nthreads, nlabels);
+  Sink sink(nthreads);
+  runner.run("vector.mul", {{"dim", dim}, {"labels", nlabels}},
+             [&](int32_t t, int64_t n) {
+               for (int64_t i = 0; i < n; i++) {
+                 outputs[t]->mul(matrix, *hidden[t]);
+               }
+               sink[t] += (*outputs[t])[0];
+             });
+}
+
+void benchQuantized(Runner& runner, const Options& options, int32_t dim) {
+  if (!runner.wantedAny(
+          {"pq.train", "qmatrix.dotRow", "qmatrix.addToVector"})) {
+    return;
+  }
+  const int32_t nthreads = maxThreads(options);
+  Matrix matrix(options.pqRows, dim);
+  matrix.uniform(1.0 / dim);
+  const Params params = {{"dim", dim}, {"rows", options.pqRows}};
+  if (runner.wanted("pq.train")) {
+    runner.runThreaded("pq.train", params, [&](int32_t threads) {
+      ProductQuantizer pq(dim, 2);
+      pq.train(options.pqRows, matrix.data(), threads);
+    });
+  }
+  if (!runner.wantedAny({"qmatrix.dotRow", "qmatrix.addToVector"})) {
+    return;
+  }
+  QMatrix qmatrix(matrix, 2, false, nthreads);
+  const std::vector<int64_t> indices = randomIndices(options.pqRows, dim);
+  Vectors vectors = randomVectors(nthreads, dim);
+  Sink sink(nthreads);
+  if (runner.wanted("qmatrix.dotRow")) {
+    runner.run("qmatrix.dotRow", params, [&](int32_t t, int64_t n) {
+      float s = 0.0;
+      for (int64_t i = 0; i < n; i++) {
+        s += qmatrix.dotRow(*vectors[t], indices[i & (NINDICES - 1)]);
+      }
+      sink[t] += s;
+    });
+  }
+  if (runner.wanted("qmatrix.addToVector")) {
+    runner.run("qmatrix.addToVector", params, [&](int32_t t, int64_t n) {
+      for (int64_t i = 0; i < n; i++) {
+        qmatrix.addToVector(*vectors[t], indices[i & (NINDICES - 1)]);
+      }
+      sink[t] += (*vectors[t])[0];
+    });
+  }
+}
+
+// Words are random strings of 3 to 12 letters, drawn with Zipf frequencies
+// in the text; line i has the label LABEL<i modulo nlabels>.
+std::vector<std::string> makeLines(int32_t nlines, int32_t nlabels,
+                                   uint32_t seed) {
+  std::minstd_rand rng(seed);
+  std::vector<std::string> vocab(VOCAB_SIZE);
+  std::uniform_int_distribution<int32_t> length(3, 12), letter('a', 'z');
+  for (auto& word : vocab) {
+    for (int32_t i = length(rng); i > 0; i--) {
+      word.push_back(letter(rng));
+    }
+  }
+  std::vector<double> weights(VOCAB_SIZE);
+  for (int32_t i = 0; i < VOCAB_SIZE; i++) {
+    weights[i] = 1.0 / (i + 1);
+  }
+  std::discrete_distribution<int32_t> zipf(weights.begin(), weights.end());
+  std::vector<std::string> lines(nlines);
+  for (int32_t i = 0; i < nlines; i++) {
+    lines[i] = LABEL + std::to_string(i % nlabels);
+    for (int32_t j = 0; j < LINE_LENGTH; j++) {
+      lines[i] += " " + vocab[zipf(rng)];
+    }
+  }
+  return lines;
+}
+
+std::shared_ptr<Dictionary> makeDictionary(
+    std::shared_ptr<Args> args, const std::vector<std::string>& lines) {
+  std::ostringstream text;
+  for (const auto& line : lines) {
+    text << line << "\n";
+  }
+  auto dict = std::make_shared<Dictionary>(args);
+  std::istringstream in(text.str());
+  dict->readFromFile(in);
+  return dict;
+}
+
+void benchDictionary(Runner& runner, const Options& options) {
+  if (!runner.wantedAny({"dictionary.hash", "dictionary.find",
+                         "dictionary.computeSubwords", "dictionary.getLine"})) {
+    return;
+  }
+  auto args = std::make_shared<Args>();
+  args->minCount = 1;
+  args->verbose = 0;
+  args->label = LABEL;
+  const std::vector<std::string> lines = makeLines(20000, 100, 0);
+  auto dict = makeDictionary(args, lines);
+  std::vector<std::string> words;
+  for (const auto& line : lines) {
+    std::istringstream in(line);
+    std::string word;
+    while (in >> word) {
+      words.push_back(word);
+    }
+  }
+  const int32_t nthreads = maxThreads(options);
+  Sink sink(nthreads);
+  const Params params = {{"words", dict->nwords()}};
+  if (runner.wanted("dictionary.hash")) {
+    runner.run("dictionary.hash", params, [&](int32_t t, int64_t n) {
+      uint32_t h = 0;
+      for (int64_t i = 0; i < n; i++) {
+        h ^= dict->hash(words[i % words.size()]);
+      }
+      sink[t] += h;
+    });
+  }
+  if (runner.wanted("dictionary.find")) {
+    runner.run("dictionary.find", params, [&](int32_t t, int64_t n) {
+      int64_t s = 0;
+      for (int64_t i = 0; i < n; i++) {
+        s += dict->getId(words[i % words.size()]);
+      }
+      sink[t] += s;
+    });
+  }
+  if (runner.wanted("dictionary.computeSubwords")) {
+    runner.run(
+        "dictionary.computeSubwords", params, [&](int32_t t, int64_t n) {
+          std::vector<int32_t> ngrams;
+          std::vector<std::string> substrings;
+          for (int64_t i = 0; i < n; i++) {
+            ngrams.clear();
+            substrings.clear();
+            dict->computeSubwords(Dictionary::BOW + words[i % words.size()] +
+                                      Dictionary::EOW,
+                                  ngrams, substrings);
+          }
+          sink[t] += ngrams.size();
+        });
+  }
+  if (runner.wanted("dictionary.getLine")) {
+    runner.run("dictionary.getLine", params, [&](int32_t t, int64_t n) {
+      std::vector<int32_t> line, labels;
+      int64_t s = 0;
+      for (int64_t i = 0; i < n; i++) {
+        std::istringstream in(lines[i % lines.size()]);
+        s += dict->getLine(in, line, labels);
+      }
+      sink[t] += s;
+    });
+  }
+}
+
+void benchPredict(Runner& runner, const Options& options, int32_t dim,
+                  int32_t nlabels, loss_name loss) {
+  const std::string name = std::string("model.predict.") +
+      (loss == loss_name::hs ? "hs" : "softmax");
+  if (!runner.wanted(name)) {
+    return;
+  }
+  auto args = std::make_shared<Args>();
+  args->model = model_name::sup;
+  args->loss = loss;
+  args->dim = dim;
+  args->minCount = 1;
+  args->verbose = 0;
+  args->label = LABEL;
+  args->wordNgrams = 2;
+  args->bucket = options.rows;
+  args->minn = 0;
+  args->maxn = 0;
+  const std::vector<std::string> lines =
+      makeLines(std::max(2000, nlabels), nlabels, dim);
+  auto dict = makeDictionary(args, lines);
+  auto input =
+      std::make_shared<Matrix>(dict->nwords() + args->bucket, args->dim);
+  input->uniform(1.0 / dim);
+  auto output = std::make_shared<Matrix>(dict->nlabels(), args->dim);
+  output->uniform(1.0 / dim);
+  std::vector<std::vector<int32_t>> inputs(lines.size());
+  std::vector<int32_t> labels;
+  for (std::size_t i = 0; i < lines.size(); i++) {
+    std::istringstream in(lines[i]);
+    dict->getLine(in, inputs[i], labels);
+  }
+  const int32_t nthreads = maxThreads(options);
+  std::vector<std::unique_ptr<Model>> models;
+  for (int32_t t = 0; t < nthreads; t++) {
+    models.emplace_back(new Model(input, output, args, t));
+    models.back()->setTargetCounts(dict->getCounts(entry_type::label));
+  }
+  Sink sink(nthreads);
+  runner.run(name, {{"dim", dim}, {"labels", dict->nlabels()}, {"k", 1}},
+             [&](int32_t t, int64_t n) {
+               std::vector<std::pair<float, int32_t>> predictions;
+               for (int64_t i = 0; i < n; i++) {
+                 predictions.clear();
+                 models[t]->predict(inputs[i % inputs.size()], 1, 0.0,
+                                    predictions);
+               }
+               sink[t] += predictions.empty() ? 0 : predictions[0].first;
+             });
+}
+
+// One softmax update per operation, with -softmaxThread set to each thread
+// count: the label ranges of an update are shared by that many threads.
+void benchSoftmaxUpdate(Runner& runner, const Options& options, int32_t dim,
+                        int32_t nlabels) {
+  if (!runner.wanted("model.update.softmax")) {
+    return;
+  }
+  auto input = std::make_shared<Matrix>(options.rows, dim);
+  input->uniform(1.0 / dim);
+  auto output = std::make_shared<Matrix>(nlabels, dim);
+  output->uniform(1.0 / dim);
+  const std::vector<int64_t> indices = randomIndices(options.rows, dim);
+  std::vector<std::vector<int32_t>> inputs(NINDICES / LINE_LENGTH);
+  for (std::size_t i = 0; i < inputs.size(); i++) {
+    for (int32_t j = 0; j < LINE_LENGTH; j++) {
+      inputs[i].push_back(indices[i * LINE_LENGTH + j]);
+    }
+  }
+  auto args = std::make_shared<Args>();
+  args->model = model_name::sup;
+  args->loss = loss_name::softmax;
+  args->dim = dim;
+  Model model(input, output, args, 0);
+  auto update = [&](int64_t n) {
+    for (int64_t i = 0; i < n; i++) {
+      model.update(inputs[i % inputs.size()], i % nlabels, 1e-6, 1.0);
+    }
+  };
+  // Calibrated on one thread, as in Runner::run.
+  int64_t iterations = 1;
+  double start = now();
+  update(iterations);
+  while (now() - start < options.minTime) {
+    iterations *= 2;
+    start = now();
+    update(iterations);
+  }
+  runner.runThreaded("model.update.softmax",
+                     {{"dim", dim}, {"labels", nlabels}},
+                     [&](int32_t threads) {
+                       args->softmaxThread = threads;
+                       update(iterations);
+                     },
+                     iterations);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const Options options = parseOptions(argc, argv);
+  Runner runner(options);
+  for (int32_t dim : options.dims) {
+    benchMatrix(runner, options, dim);
+    for (int32_t nlabels : options.labels) {
+      benchVectorMul(runner, options, dim, nlabels);
+    }
+    benchQuantized(runner, options, dim);
+    for (int32_t nlabels : options.labels) {
+      benchPredict(runner, options, dim, nlabels, loss_name::softmax);
+      benchPredict(runner, options, dim, nlabels, loss_name::hs);
+      benchSoftmaxUpdate(runner, options, dim, nlabels);
+    }
+  }
+  benchDictionary(runner, options);
+  return 0;
+}
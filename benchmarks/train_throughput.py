@@ -0,0 +1,185 @@
+#!/usr/bin/env python
+# Copyright (c) 2017-present, Facebook, Inc.
+# All rights reserved.
+#
+# This source code is licensed under the BSD-style license found in the
+# LICENSE file in the root directory of this source tree. An additional grant
+# of patent rights can be found in the PATENTS file in the same directory.
+
+# Training throughput on synthetic corpora: generates them with
+# fasttext-gencorpus, trains skipgram, cbow and supervised models on a fixed
+# token budget with every thread count asked for, and reports words per
+# second per thread, the scaling efficiency against the fewest threads, the
+# peak resident memory and the final loss.
+
+from __future__ import absolute_import
+from __future__ import division
+from __future__ import print_function
+from __future__ import unicode_literals
+
+import argparse
+import json
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+PROGRESS = re.compile(
+    r'Progress:\s*([\d.]+)%\s*words/sec/thread:\s*(\d+)'
+    r'\s*lr:\s*[-\d.]+\s*loss:\s*([-\d.naif]+)')
+LABEL_PREFIX = '__label__'
+
+
+def generate(args, path, labels):
+    command = [
+        args.gencorpus, '-output', path, '-tokens', str(args.tokens),
+        '-vocab', str(args.vocab), '-zipf', str(args.zipf),
+        '-seed', str(args.seed)
+    ]
+    if labels:
+        command += ['-labels', str(args.labels),
+                    '-labelPrefix', LABEL_PREFIX]
+    summary = subprocess.check_output(
+        command, stderr=subprocess.STDOUT).decode('utf-8').split()
+    counts = dict(zip(summary[::2], map(int, summary[1::2])))
+    # The dictionary counts labels as tokens too.
+    return counts['words'] + counts['labels']
+
+
+def train(args, model, corpus, ntokens, threads):
+    """Runs one training. Its wall-clock speed is taken between the first and
+    the last progress reports, timed as they are printed, so that reading the
+    dictionary and initializing the matrices are left out."""
+    output = os.path.join(args.workdir, model)
+    command = [
+        args.bin, model, '-input', corpus, '-output', output,
+        '-thread', str(threads), '-epoch', str(args.epoch),
+        '-dim', str(args.dim), '-label', LABEL_PREFIX, '-verbose', '2'
+    ] + args.extra.split()
+    process = subprocess.Popen(
+        command, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE)
+    log = ''
+    reports = []
+    while True:
+        chunk = os.read(process.stderr.fileno(), 65536)
+        if not chunk:
+            break
+        now = time.time()
+        log += chunk.decode('utf-8', 'replace')
+        progress = PROGRESS.findall(log[-4096:])
+        if progress:
+            reports.append((now, float(progress[-1][0])))
+    _, status, usage = os.wait4(process.pid, 0)
+    process.stderr.close()
+    if status != 0:
+        sys.stderr.write(log)
+        raise RuntimeError('training failed: ' + ' '.join(command))
+    progress = PROGRESS.findall(log)
+    if not progress:
+        raise RuntimeError('no progress reported: ' + ' '.join(command))
+    _, words_per_thread, loss = progress[-1]
+    total = ntokens * args.epoch
+    (start, first), (end, last) = reports[0], reports[-1]
+    if end > start and last > first:
+        wall = (last - first) / 100.0 * total / (end - start)
+    else:
+        wall = float('nan')
+    return {
+        'model': model,
+        'threads': threads,
+        'tokens': total,
+        # fastText's own figure, from the process CPU time.
+        'words_per_sec_per_thread': int(words_per_thread),
+        # From the wall clock, which also counts waiting and contention.
+        'wall_words_per_sec': wall,
+        # ru_maxrss is in kilobytes on Linux.
+        'peak_rss_mb': usage.ru_maxrss / 1024.0,
+        'loss': float(loss),
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Training throughput on synthetic Zipfian corpora.')
+    parser.add_argument('--bin', default='./fastertext',
+                        help='fastText binary')
+    parser.add_argument('--gencorpus', default='./fastertext-gencorpus',
+                        help='corpus generator binary')
+    parser.add_argument('--models', default='skipgram,cbow,supervised')
+    parser.add_argument('--threads', default=None,
+                        help='comma-separated thread counts '
+                        '[powers of two up to the number of CPUs]')
+    parser.add_argument('--tokens', type=int, default=10000000,
+                        help='words in each corpus')
+    parser.add_argument('--epoch', type=int, default=1)
+    parser.add_argument('--dim', type=int, default=100)
+    parser.add_argument('--vocab', type=int, default=100000)
+    parser.add_argument('--zipf', type=float, default=1.0)
+    parser.add_argument('--labels', type=int, default=100)
+    parser.add_argument('--seed', type=int, default=1)
+    parser.add_argument('--extra', default='',
+                        help='more arguments for every training')
+    parser.add_argument('--workdir', default=None,
+                        help='where corpora and models go [a temporary '
+                        'directory, removed afterwards]')
+    parser.add_argument('--json', default=None,
+                        help='also write the results here, one per line')
+    args = parser.parse_args()
+
+    if args.threads is None:
+        ncpus = os.cpu_count() or 1
+        threads = [1]
+        while threads[-1] * 2 <= ncpus:
+            threads.append(threads[-1] * 2)
+        if threads[-1] != ncpus:
+            threads.append(ncpus)
+    else:
+        threads = sorted(int(t) for t in args.threads.split(','))
+    models = args.models.split(',')
+
+    cleanup = args.workdir is None
+    if cleanup:
+        args.workdir = tempfile.mkdtemp(prefix='fasttext-throughput-')
+    try:
+        corpora = {}
+        if any(m != 'supervised' for m in models):
+            path = os.path.join(args.workdir, 'unsup.txt')
+            corpora[False] = (path, generate(args, path, False))
+        if 'supervised' in models:
+            path = os.path.join(args.workdir, 'sup.txt')
+            corpora[True] = (path, generate(args, path, True))
+
+        results = []
+        print('%-10s %7s %14s %14s %10s %9s %9s' %
+              ('model', 'threads', 'words/s/thread', 'wall words/s',
+               'efficiency', 'rss MB', 'loss'))
+        for model in models:
+            corpus, ntokens = corpora[model == 'supervised']
+            base = None
+            for t in threads:
+                result = train(args, model, corpus, ntokens, t)
+                if base is None:
+                    base = result['wall_words_per_sec'] / t
+                result['scaling_efficiency'] = (
+                    result['wall_words_per_sec'] / (t * base))
+                results.append(result)
+                print('%-10s %7d %14d %14.0f %10.2f %9.1f %9.4f' %
+                      (model, t, result['words_per_sec_per_thread'],
+                       result['wall_words_per_sec'],
+                       result['scaling_efficiency'], result['peak_rss_mb'],
+                       result['loss']))
+                sys.stdout.flush()
+        if args.json:
+            with open(args.json, 'w') as f:
+                for result in results:
+                    f.write(json.dumps(result, sort_keys=True) + '\n')
+    finally:
+        if cleanup:
+            shutil.rmtree(args.workdir)
+
+
+if __name__ == '__main__':
+    main()
@@ -17,6 +17,7 @@ from setuptools.command.build_ext import build_ext
 import sys
 import setuptools
 import os
+import platform
 
 __version__ = '0.8.22'
 FASTTEXT_SRC = "src"
@@ -45,6 +46,15 @@ fasttext_src_cc = list(
     map(lambda x: str(os.path.join(FASTTEXT_SRC, x)), fasttext_src_cc)
 )
 
+# Only the kernels are built for more than the baseline instruction set; the
+# variant to run is chosen at startup from cpuid.
+kernel_flags = {
+    'kernels_sse42.cc': ['-msse4.2'],
+    'kernels_avx2.cc': ['-mavx2', '-mfma'],
+    'kernels_avx512.cc': ['-mavx512f', '-mavx2', '-mfma'],
+}
+x86_machines = ('x86_64', 'AMD64', 'i386', 'i686')
+
 ext_modules = [
     Extension(
         str('fasttext_pybind'),
@@ -58,8 +68,9 @@ ext_modules = [
             # Path to fasttext source code
             FASTTEXT_SRC,
         ],
+        libraries=['z'],
         language='c++',
-        extra_compile_args=["-O3 -funroll-loops -pthread -march=native"],
+        extra_compile_args=["-O3 -funroll-loops -pthread"],
     ),
 ]
 
@@ -126,8 +137,22 @@ class BuildExt(build_ext):
             )
         for ext in self.extensions:
             ext.extra_compile_args = opts
+        if ct == 'unix' and platform.machine() in x86_machines:
+            self._add_kernel_flags()
         build_ext.build_extensions(self)
 
+    def _add_kernel_flags(self):
+        """Compiles each kernel file with the flags of its instruction set.
+        Without them a kernel file only builds its scalar fallback.
+        """
+        compile_one = self.compiler._compile
+
+        def _compile(obj, src, ext, cc_args, extra_postargs, pp_opts):
+            flags = kernel_flags.get(os.path.basename(src), [])
+            compile_one(obj, src, ext, cc_args, extra_postargs + flags, pp_opts)
+
+        self.compiler._compile = _compile
+
 
 def _get_readme():
     """
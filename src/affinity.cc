@@ -0,0 +1,279 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "affinity.h"
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <utility>
+
+namespace fasttext {
+
+namespace affinity {
+
+#if defined(__linux__)
+
+namespace {
+
+struct Cpu {
+  int32_t id;
+  int32_t package;
+  int32_t core;
+};
+
+int32_t readTopology(int32_t cpu, const std::string& name, int32_t missing) {
+  std::ifstream in("/sys/devices/system/cpu/cpu" + std::to_string(cpu) +
+                   "/topology/" + name);
+  int32_t value;
+  if (!(in >> value)) {
+    return missing;
+  }
+  return value;
+}
+
+// The CPUs the process may run on, as it started.
+const cpu_set_t& processSet() {
+  static cpu_set_t set;
+  static std::once_flag once;
+  std::call_once(once, []() {
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+      CPU_ZERO(&set);
+    }
+  });
+  return set;
+}
+
+std::vector<Cpu> allowedCpus() {
+  std::vector<Cpu> cpus;
+  const cpu_set_t& set = processSet();
+  for (int32_t i = 0; i < CPU_SETSIZE; i++) {
+    if (CPU_ISSET(i, &set)) {
+      cpus.push_back(Cpu{i, readTopology(i, "physical_package_id", 0),
+                         readTopology(i, "core_id", i)});
+    }
+  }
+  return cpus;
+}
+
+void sortCompact(std::vector<Cpu>& cpus) {
+  std::sort(cpus.begin(), cpus.end(), [](const Cpu& a, const Cpu& b) {
+    return std::tie(a.package, a.core, a.id) <
+        std::tie(b.package, b.core, b.id);
+  });
+}
+
+std::vector<int32_t> compactOrder(std::vector<Cpu> cpus) {
+  sortCompact(cpus);
+  std::vector<int32_t> order;
+  for (const auto& cpu : cpus) {
+    order.push_back(cpu.id);
+  }
+  return order;
+}
+
+// Sorted by hardware thread within the core, then by core within the
+// socket, then by socket.
+std::vector<int32_t> scatterOrder(std::vector<Cpu> cpus) {
+  sortCompact(cpus);
+  std::map<std::pair<int32_t, int32_t>, int32_t> threads;
+  std::map<int32_t, int32_t> cores;
+  std::vector<std::tuple<int32_t, int32_t, int32_t, int32_t>> keys;
+  for (const auto& cpu : cpus) {
+    const auto core = std::make_pair(cpu.package, cpu.core);
+    if (threads.count(core) == 0) {
+      threads[core] = 0;
+      cores[cpu.package]++;
+    }
+    keys.push_back(std::make_tuple(threads[core]++, cores[cpu.package] - 1,
+                                   cpu.package, cpu.id));
+  }
+  std::sort(keys.begin(), keys.end());
+  std::vector<int32_t> order;
+  for (const auto& key : keys) {
+    order.push_back(std::get<3>(key));
+  }
+  return order;
+}
+
+// "0,2,8-11"; empty if it is not such a list.
+std::vector<int32_t> parseList(const std::string& list) {
+  std::vector<int32_t> order;
+  std::istringstream in(list);
+  std::string item;
+  while (std::getline(in, item, ',')) {
+    int32_t first, last;
+    char dash;
+    std::istringstream range(item);
+    if (!(range >> first) || first < 0 || first >= CPU_SETSIZE) {
+      return {};
+    }
+    last = first;
+    if (range >> dash && (dash != '-' || !(range >> last) || last < first ||
+                          last >= CPU_SETSIZE)) {
+      return {};
+    }
+    for (int32_t cpu = first; cpu <= last; cpu++) {
+      order.push_back(cpu);
+    }
+  }
+  return order;
+}
+
+// The CPUs of a list that the process may run on; the others are dropped
+// with a warning, since no thread can be pinned to them.
+std::vector<int32_t> allowedList(const std::string& policy) {
+  const cpu_set_t& set = processSet();
+  std::vector<int32_t> order, dropped;
+  for (int32_t cpu : parseList(policy)) {
+    (CPU_ISSET(cpu, &set) ? order : dropped).push_back(cpu);
+  }
+  if (!dropped.empty()) {
+    std::cerr << "Warning: FASTTEXT_AFFINITY=" << policy
+              << ": ignoring CPUs the process may not run on:";
+    for (int32_t cpu : dropped) {
+      std::cerr << " " << cpu;
+    }
+    std::cerr << std::endl;
+  }
+  return order;
+}
+
+std::vector<int32_t> chooseCpus() {
+  const char* env = std::getenv("FASTTEXT_AFFINITY");
+  if (env == nullptr) {
+    return {};
+  }
+  const std::string policy(env);
+  if (policy.empty() || policy == "none") {
+    return {};
+  }
+  if (policy == "compact") {
+    return compactOrder(allowedCpus());
+  }
+  if (policy == "scatter") {
+    return scatterOrder(allowedCpus());
+  }
+  if (parseList(policy).empty()) {
+    std::cerr << "Warning: FASTTEXT_AFFINITY=" << policy
+              << " is not none, compact, scatter or a list of CPUs, "
+              << "threads are not pinned" << std::endl;
+    return {};
+  }
+  return allowedList(policy);
+}
+
+void record(const char* pool, int32_t index, int32_t cpu) {
+  static const char* path = std::getenv("FASTTEXT_AFFINITY_FILE");
+  if (path == nullptr) {
+    return;
+  }
+  static std::mutex mutex;
+  static std::set<std::pair<std::string, int32_t>> seen;
+  static std::ofstream out(path);
+  std::lock_guard<std::mutex> guard(mutex);
+  if (!seen.insert(std::make_pair(std::string(pool), index)).second) {
+    return;
+  }
+  out << pool << " " << index << " " << syscall(SYS_gettid) << " " << cpu
+      << std::endl;
+}
+
+}  // namespace
+
+// The process mask is read on first use, before any thread is pinned.
+const std::vector<int32_t>& cpus() {
+  processSet();
+  static const std::vector<int32_t> order = chooseCpus();
+  return order;
+}
+
+void pin(const char* pool, int32_t index) {
+  const std::vector<int32_t>& order = cpus();
+  if (order.empty()) {
+    return;
+  }
+  const int32_t cpu = order[index % order.size()];
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0) {
+    record(pool, index, cpu);
+  }
+}
+
+void unpin() {
+  if (cpus().empty()) {
+    return;
+  }
+  pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &processSet());
+}
+
+ScopedPin::ScopedPin(const char* pool, int32_t index) {
+  if (cpus().empty()) {
+    return;
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  pthread_getaffinity_np(pthread_self(), sizeof(set), &set);
+  for (int32_t cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, &set)) {
+      saved_.push_back(cpu);
+    }
+  }
+  pin(pool, index);
+}
+
+ScopedPin::~ScopedPin() {
+  if (saved_.empty()) {
+    return;
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int32_t cpu : saved_) {
+    CPU_SET(cpu, &set);
+  }
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+#else
+
+const std::vector<int32_t>& cpus() {
+  static const std::vector<int32_t> order;
+  return order;
+}
+
+void pin(const char*, int32_t) {}
+
+void unpin() {}
+
+ScopedPin::ScopedPin(const char*, int32_t) {}
+
+ScopedPin::~ScopedPin() {}
+
+#endif
+
+}  // namespace affinity
+
+}  // namespace fasttext
@@ -0,0 +1,59 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace fasttext {
+
+// Pinning of worker threads to CPUs, chosen with the FASTTEXT_AFFINITY
+// environment variable:
+//   none     threads are left to the scheduler (the default);
+//   compact  workers fill the hardware threads of a core, then the next
+//            core of the same socket, then the next socket;
+//   scatter  workers go to a different core each, alternating sockets,
+//            before any core gets a second one;
+//   a list   such as 0,2,8-11: worker i runs on the i-th CPU listed.
+// Any other value, and listed CPUs the process may not run on, are ignored
+// with a warning. Worker i of a pool with more workers than CPUs shares the
+// CPU of worker i modulo the number of CPUs. When FASTTEXT_AFFINITY_FILE
+// names a file, the first thread pinned to each worker slot of each pool is
+// written to it as one "<pool> <worker> <tid> <cpu>" line.
+namespace affinity {
+
+// The CPUs workers are assigned to, in order; empty when threads are not
+// pinned.
+const std::vector<int32_t>& cpus();
+
+// Pins the calling thread, worker index of pool.
+void pin(const char* pool, int32_t index);
+
+// Lets the calling thread run on any CPU of the process again, for helper
+// threads started from a pinned worker.
+void unpin();
+
+// Pins the calling thread, worker index of pool, until the end of the
+// scope, and then gives it back the CPUs it had: for the worker that a pool
+// runs on the thread that started the others.
+class ScopedPin {
+ public:
+  ScopedPin(const char* pool, int32_t index);
+  ~ScopedPin();
+  ScopedPin(const ScopedPin&) = delete;
+  ScopedPin& operator=(const ScopedPin&) = delete;
+
+ private:
+  std::vector<int32_t> saved_;
+};
+
+}  // namespace affinity
+
+}  // namespace fasttext
@@ -32,6 +32,7 @@ Args::Args()
       minn(3),
       maxn(6),
       thread(0),
+      softmaxThread(1),
       t(1e-4),
       label("__label__"),
       verbose(2),
@@ -42,7 +43,11 @@ Args::Args()
       retrain(false),
       qnorm(false),
       cutoff(0),
-      dsub(2) {}
+      cutoffFreq(false),
+      dsub(2),
+      kmeanspp(false),
+      qtol(0.0),
+      qbits(8) {}
 
 std::string Args::lossToString(loss_name ln) const {
   switch (ln) {
@@ -135,6 +140,8 @@ void Args::parseArgs(const std::vector<std::string>& args) {
         maxn = std::stoi(args.at(ai + 1));
       } else if (args[ai] == "-thread") {
         thread = std::stoi(args.at(ai + 1));
+      } else if (args[ai] == "-softmaxThread") {
+        softmaxThread = std::stoi(args.at(ai + 1));
       } else if (args[ai] == "-t") {
         t = std::stof(args.at(ai + 1));
       } else if (args[ai] == "-label") {
@@ -160,8 +167,18 @@ void Args::parseArgs(const std::vector<std::string>& args) {
         ai--;
       } else if (args[ai] == "-cutoff") {
         cutoff = std::stoi(args.at(ai + 1));
+      } else if (args[ai] == "-cutoffFreq") {
+        cutoffFreq = true;
+        ai--;
       } else if (args[ai] == "-dsub") {
         dsub = std::stoi(args.at(ai + 1));
+      } else if (args[ai] == "-kmeanspp") {
+        kmeanspp = true;
+        ai--;
+      } else if (args[ai] == "-qtol") {
+        qtol = std::stof(args.at(ai + 1));
+      } else if (args[ai] == "-qbits") {
+        qbits = std::stoi(args.at(ai + 1));
       } else {
         std::cerr << "Unknown argument: " << args[ai] << std::endl;
         printHelp();
@@ -202,7 +219,7 @@ void Args::printHelp() {
 
 void Args::printBasicHelp() {
   std::cerr << "\nThe following arguments are mandatory:\n"
-            << "  -input              training file path\n"
+            << "  -input              training file path (plain text or gzip)\n"
             << "  -output             output file path\n"
             << "\nThe following arguments are optional:\n"
             << "  -verbose            verbosity level [" << verbose << "]\n";
@@ -241,6 +258,8 @@ void Args::printTrainingHelp() {
             << lossToString(loss) << "]\n"
             << "  -thread             number of threads [" << thread
             << "] (0 for default: #CPUs)\n"
+            << "  -softmaxThread      threads sharing each softmax update ["
+            << softmaxThread << "]\n"
             << "  -pretrainedVectors  pretrained word vectors for supervised "
                "learning ["
             << pretrainedVectors << "]\n"
@@ -253,6 +272,9 @@ void Args::printQuantizationHelp() {
       << "\nThe following arguments for quantization are optional:\n"
       << "  -cutoff             number of words and ngrams to retain ["
       << cutoff << "]\n"
+      << "  -cutoffFreq         whether the cutoff keeps the most used rows "
+         "instead of the largest norms ["
+      << boolToString(cutoffFreq) << "]\n"
       << "  -retrain            whether embeddings are finetuned if a cutoff "
          "is applied ["
       << boolToString(retrain) << "]\n"
@@ -260,7 +282,14 @@ void Args::printQuantizationHelp() {
       << boolToString(qnorm) << "]\n"
       << "  -qout               whether the classifier is quantized ["
       << boolToString(qout) << "]\n"
-      << "  -dsub               size of each sub-vector [" << dsub << "]\n";
+      << "  -dsub               size of each sub-vector [" << dsub << "]\n"
+      << "  -qbits              bits per sub-vector code {4, 8} [" << qbits
+      << "]\n"
+      << "  -kmeanspp           whether centroids are seeded with k-means++ ["
+      << boolToString(kmeanspp) << "]\n"
+      << "  -qtol               relative k-means improvement under which "
+         "training stops ["
+      << qtol << "]\n";
 }
 
 void Args::save(std::ostream& out) const {
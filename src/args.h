@@ -44,6 +44,7 @@ class Args {
   int minn;
   int maxn;
   int thread;
+  int softmaxThread;
   double t;
   std::string label;
   int verbose;
@@ -55,7 +56,11 @@ class Args {
   bool retrain;
   bool qnorm;
   size_t cutoff;
+  bool cutoffFreq;
   size_t dsub;
+  bool kmeanspp;
+  double qtol;
+  int qbits;
 
   void parseArgs(const std::vector<std::string>& args);
   void printHelp();
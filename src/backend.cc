@@ -0,0 +1,134 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "backend.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include "hugepages.h"
+
+#if defined(FASTTEXT_BACKEND_IPP)
+#include <ipp.h>
+#else
+#include "kernels.h"
+#endif
+
+namespace fasttext {
+
+namespace backend {
+
+#if defined(FASTTEXT_BACKEND_IPP)
+
+float* allocate(int64_t n) {
+  if (void* huge = hugepages::allocate(n * sizeof(float))) {
+    return static_cast<float*>(huge);
+  }
+  float* p = ippsMalloc_32f_L(n > 0 ? n : 1);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void release(float* p) {
+  if (!hugepages::release(p)) {
+    ippsFree(p);
+  }
+}
+
+void zero(float* x, int64_t n) { ippsZero_32f(x, n); }
+
+void scale(float a, float* x, int64_t n) { ippsMulC_32f_I(a, x, n); }
+
+void add(const float* x, float* y, int64_t n) { ippsAdd_32f_I(x, y, n); }
+
+void axpy(float a, const float* x, float* y, int64_t n) {
+  ippsAddProductC_32f(x, a, y, n);
+}
+
+void axpy2(float a, const float* x, float* y, float* z, int64_t n) {
+  ippsAddProductC_32f(y, a, z, n);
+  ippsAddProductC_32f(x, a, y, n);
+}
+
+float dot(const float* x, const float* y, int64_t n) {
+  float d;
+  ippsDotProd_32f(x, y, n, &d);
+  return d;
+}
+
+float norm(const float* x, int64_t n) {
+  float r;
+  ippsNorm_L2_32f(x, n, &r);
+  return r;
+}
+
+const char* name() { return "ipp"; }
+
+#else
+
+#if defined(FASTTEXT_BACKEND_SCALAR)
+static const kernels::KernelOps& ops() { return kernels::scalarOps(); }
+#else
+static const kernels::KernelOps& ops() { return kernels::ops(); }
+#endif
+
+float* allocate(int64_t n) {
+  if (void* huge = hugepages::allocate(n * sizeof(float))) {
+    return static_cast<float*>(huge);
+  }
+  void* p = nullptr;
+  if (posix_memalign(&p, 64, (n > 0 ? n : 1) * sizeof(float)) != 0) {
+    throw std::bad_alloc();
+  }
+  return static_cast<float*>(p);
+}
+
+void release(float* p) {
+  if (!hugepages::release(p)) {
+    free(p);
+  }
+}
+
+void zero(float* x, int64_t n) { std::memset(x, 0, n * sizeof(float)); }
+
+void scale(float a, float* x, int64_t n) { ops().scale(a, x, n); }
+
+void add(const float* x, float* y, int64_t n) { ops().axpy(1.0, x, y, n); }
+
+void axpy(float a, const float* x, float* y, int64_t n) {
+  ops().axpy(a, x, y, n);
+}
+
+void axpy2(float a, const float* x, float* y, float* z, int64_t n) {
+  ops().axpy2(a, x, y, z, n);
+}
+
+float dot(const float* x, const float* y, int64_t n) {
+  return ops().dot(x, y, n);
+}
+
+float norm(const float* x, int64_t n) {
+  return std::sqrt(ops().dot(x, x, n));
+}
+
+#if defined(FASTTEXT_BACKEND_SCALAR)
+const char* name() { return "scalar"; }
+#else
+const char* name() { return "simd"; }
+#endif
+
+#endif
+
+}  // namespace backend
+
+}  // namespace fasttext
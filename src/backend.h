@@ -0,0 +1,42 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace fasttext {
+
+// Buffers and row operations of Vector and Matrix. The implementation is
+// chosen at build time: Intel IPP with FASTTEXT_BACKEND_IPP, the scalar
+// reference kernels with FASTTEXT_BACKEND_SCALAR, and otherwise the SIMD
+// kernels dispatched at runtime.
+namespace backend {
+
+// 64-byte aligned, uninitialized; on huge pages for large buffers when
+// FASTTEXT_HUGEPAGES asks for them (see hugepages.h).
+float* allocate(int64_t);
+void release(float*);
+
+void zero(float*, int64_t);
+// x *= a.
+void scale(float, float*, int64_t);
+// y += x.
+void add(const float*, float*, int64_t);
+// y += a * x.
+void axpy(float, const float*, float*, int64_t);
+// z += a * y, then y += a * x.
+void axpy2(float, const float*, float*, float*, int64_t);
+float dot(const float*, const float*, int64_t);
+float norm(const float*, int64_t);
+
+const char* name();
+}  // namespace backend
+
+}  // namespace fasttext
@@ -0,0 +1,279 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "chunkqueue.h"
+
+#include "gzip.h"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+
+namespace fasttext {
+
+ChunkQueue::ChunkQueue(const std::string& filename, int32_t nthreads,
+                       int64_t chunkSize, uint32_t seed)
+    : format_(format::text),
+      queues_(nthreads),
+      epoch_(-1),
+      rng_(seed),
+      capacity_(2 * nthreads),
+      stop_(false) {
+  std::ifstream in(filename, std::ifstream::binary);
+  if (!in.is_open()) {
+    throw std::invalid_argument(filename + " cannot be opened for training!");
+  }
+  in.seekg(0, std::ifstream::end);
+  const int64_t size = in.tellg();
+  if (size <= 0) {
+    throw std::invalid_argument(filename + " is empty!");
+  }
+  chunkSize = std::max<int64_t>(1, std::min(chunkSize, size / (4 * nthreads)));
+  if (!gzip::isGzip(filename)) {
+    alignBounds(in, size, chunkSize);
+    return;
+  }
+  bounds_ = gzip::bgzfBounds(filename, chunkSize);
+  if (!bounds_.empty()) {
+    format_ = format::bgzf;
+    return;
+  }
+  format_ = format::gzip;
+  inflater_ = std::thread([=]() { inflate(filename, chunkSize); });
+}
+
+ChunkQueue::~ChunkQueue() {
+  if (inflater_.joinable()) {
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      stop_ = true;
+    }
+    space_.notify_all();
+    inflater_.join();
+  }
+}
+
+// Boundaries are moved to the start of the next line, so chunks hold whole
+// lines and are about chunkSize bytes; each thread gets at least a few.
+void ChunkQueue::alignBounds(std::ifstream& in, int64_t size,
+                             int64_t chunkSize) {
+  bounds_.push_back(0);
+  for (int64_t offset = chunkSize; offset < size; offset += chunkSize) {
+    if (offset <= bounds_.back()) {
+      continue;
+    }
+    in.clear();
+    in.seekg(offset - 1);
+    in.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    if (!in || in.tellg() >= size) {
+      break;
+    }
+    const int64_t bound = in.tellg();
+    if (bound > bounds_.back()) {
+      bounds_.push_back(bound);
+    }
+  }
+  bounds_.push_back(size);
+}
+
+ChunkQueue::format ChunkQueue::getFormat() const { return format_; }
+
+int64_t ChunkQueue::size() const {
+  return bounds_.empty() ? 0 : bounds_.size() - 1;
+}
+
+// Called with mutex_ held, once every queue is empty.
+void ChunkQueue::deal() {
+  std::vector<int32_t> order(size());
+  std::iota(order.begin(), order.end(), 0);
+  std::shuffle(order.begin(), order.end(), rng_);
+  for (int64_t i = 0; i < order.size(); i++) {
+    queues_[i % queues_.size()].push_back(order[i]);
+  }
+  epoch_++;
+}
+
+ChunkQueue::Chunk ChunkQueue::next(int32_t thread) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  auto largest = [this]() {
+    return &*std::max_element(
+        queues_.begin(), queues_.end(),
+        [](const std::deque<int32_t>& a, const std::deque<int32_t>& b) {
+          return a.size() < b.size();
+        });
+  };
+  std::deque<int32_t>* queue = &queues_[thread];
+  if (queue->empty()) {
+    queue = largest();
+  }
+  if (queue->empty()) {
+    deal();
+    // With fewer chunks than threads, some threads are dealt none.
+    queue = queues_[thread].empty() ? largest() : &queues_[thread];
+  }
+  int32_t chunk;
+  if (queue == &queues_[thread]) {
+    chunk = queue->front();
+    queue->pop_front();
+  } else {
+    chunk = queue->back();
+    queue->pop_back();
+  }
+  return Chunk{bounds_[chunk], bounds_[chunk + 1], epoch_};
+}
+
+// Chunks are cut after the last newline of about chunkSize inflated bytes;
+// the rest is carried over to the next one.
+void ChunkQueue::inflate(const std::string& filename, int64_t chunkSize) {
+  std::vector<char> buffer(chunkSize);
+  while (true) {
+    gzip::Streambuf in(filename);
+    std::string chunk;
+    std::streamsize n;
+    while ((n = in.sgetn(buffer.data(), buffer.size())) > 0) {
+      chunk.append(buffer.data(), n);
+      const std::size_t cut = chunk.rfind('\n');
+      if (int64_t(chunk.size()) < chunkSize || cut == std::string::npos) {
+        continue;
+      }
+      std::string rest = chunk.substr(cut + 1);
+      chunk.resize(cut + 1);
+      if (!push(chunk)) {
+        return;
+      }
+      chunk = std::move(rest);
+    }
+    if (!chunk.empty() && !push(chunk)) {
+      return;
+    }
+  }
+}
+
+bool ChunkQueue::push(std::string& chunk) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  space_.wait(lock, [this]() { return stop_ || inflated_.size() < capacity_; });
+  if (stop_) {
+    return false;
+  }
+  inflated_.push_back(std::move(chunk));
+  ready_.notify_one();
+  return true;
+}
+
+void ChunkQueue::pop(std::string& chunk) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  ready_.wait(lock, [this]() { return !inflated_.empty(); });
+  chunk = std::move(inflated_.front());
+  inflated_.pop_front();
+  space_.notify_one();
+}
+
+ChunkReader::ChunkReader(const std::string& filename, ChunkQueue& queue,
+                         int32_t thread)
+    : in_(filename, std::ifstream::binary),
+      queue_(queue),
+      thread_(thread),
+      pos_(0) {
+  if (!in_.is_open()) {
+    throw std::invalid_argument(filename + " cannot be opened for training!");
+  }
+}
+
+void ChunkReader::fill() {
+  pos_ = 0;
+  if (queue_.getFormat() == ChunkQueue::format::gzip) {
+    queue_.pop(buffer_);
+    return;
+  }
+  const ChunkQueue::Chunk chunk = queue_.next(thread_);
+  if (queue_.getFormat() == ChunkQueue::format::bgzf) {
+    fillBgzf(chunk);
+    return;
+  }
+  buffer_.resize(chunk.end - chunk.begin);
+  in_.clear();
+  in_.seekg(chunk.begin);
+  in_.read(&buffer_[0], buffer_.size());
+  buffer_.resize(in_.gcount());
+}
+
+// Inflates the BGZF block at offset, if any, onto buffer_.
+bool ChunkReader::appendBlock(int64_t& offset) {
+  unsigned char header[gzip::BGZF_HEADER_SIZE];
+  in_.clear();
+  in_.seekg(offset);
+  if (!in_.read(reinterpret_cast<char*>(header), sizeof(header))) {
+    return false;
+  }
+  const int64_t size = gzip::bgzfBlockSize(header);
+  if (size < int64_t(sizeof(header))) {
+    return false;
+  }
+  compressed_.assign(reinterpret_cast<char*>(header), sizeof(header));
+  compressed_.resize(size);
+  if (!in_.read(&compressed_[sizeof(header)], size - sizeof(header))) {
+    return false;
+  }
+  gzip::inflateMembers(compressed_.data(), size, buffer_);
+  offset += size;
+  return true;
+}
+
+// The first newline in buffer_ from position from on, inflating the blocks
+// at offset and after as needed; npos at the end of the file.
+std::size_t ChunkReader::findNewline(std::size_t from, int64_t& offset) {
+  std::size_t newline;
+  while ((newline = buffer_.find('\n', from)) == std::string::npos) {
+    from = buffer_.size();
+    if (!appendBlock(offset)) {
+      break;
+    }
+  }
+  return newline;
+}
+
+// Keeps the lines that start in the chunk or right at its end, except the
+// first one unless the chunk starts the file.
+void ChunkReader::fillBgzf(const ChunkQueue::Chunk& chunk) {
+  compressed_.resize(chunk.end - chunk.begin);
+  in_.clear();
+  in_.seekg(chunk.begin);
+  in_.read(&compressed_[0], compressed_.size());
+  buffer_.clear();
+  gzip::inflateMembers(compressed_.data(), in_.gcount(), buffer_);
+  const std::size_t length = buffer_.size();
+  int64_t offset = chunk.end;
+  if (chunk.begin > 0) {
+    const std::size_t first = findNewline(0, offset);
+    if (first == std::string::npos || first + 1 > length) {
+      buffer_.clear();
+      return;
+    }
+    pos_ = first + 1;
+  }
+  const std::size_t last = findNewline(length, offset);
+  if (last != std::string::npos) {
+    buffer_.resize(last + 1);
+  }
+}
+
+void ChunkReader::getline(std::string& line) {
+  while (pos_ >= buffer_.size()) {
+    fill();
+  }
+  std::size_t end = buffer_.find('\n', pos_);
+  if (end == std::string::npos) {
+    end = buffer_.size();
+  }
+  line.assign(buffer_, pos_, end - pos_);
+  pos_ = end + 1;
+}
+
+}  // namespace fasttext
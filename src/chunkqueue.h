@@ -0,0 +1,102 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace fasttext {
+
+// Splits a training file into line-aligned chunks and hands them out to the
+// training threads. Every epoch the chunks are shuffled and dealt
+// round-robin to the threads; a thread takes its own chunks first and, once
+// it has none left, steals from the back of the thread with the most left.
+// Every chunk is read once per epoch, whatever the speed of each thread, and
+// a new epoch starts when all the chunks of the current one are taken.
+//
+// BGZF files are chunked on block boundaries, which need not be line
+// boundaries: a line belongs to the chunk it starts in, or to the previous
+// chunk if it starts right at a boundary, so each reader skips the first
+// line of its chunk and reads on past its end to finish the last one. A plain
+// gzip file cannot be split: a background thread inflates it from the start,
+// over and over, and queues chunks of whole lines in file order for the
+// threads to take.
+class ChunkQueue {
+ public:
+  enum class format { text, bgzf, gzip };
+
+  struct Chunk {
+    int64_t begin;
+    int64_t end;
+    int64_t epoch;
+  };
+
+  ChunkQueue(const std::string&, int32_t, int64_t, uint32_t);
+  ~ChunkQueue();
+
+  format getFormat() const;
+  Chunk next(int32_t);
+  void pop(std::string&);
+  int64_t size() const;
+
+ private:
+  format format_;
+  // Chunk i is the bytes [bounds_[i], bounds_[i + 1]).
+  std::vector<int64_t> bounds_;
+  std::vector<std::deque<int32_t>> queues_;
+  int64_t epoch_;
+  std::minstd_rand rng_;
+  std::mutex mutex_;
+
+  // Chunks inflated from a plain gzip file.
+  std::deque<std::string> inflated_;
+  std::size_t capacity_;
+  bool stop_;
+  std::condition_variable ready_;
+  std::condition_variable space_;
+  std::thread inflater_;
+
+  void alignBounds(std::ifstream&, int64_t, int64_t);
+  void deal();
+  void inflate(const std::string&, int64_t);
+  bool push(std::string&);
+};
+
+// The lines of the chunks that a ChunkQueue hands to one thread. Chunks are
+// read (and inflated) whole, so lines are split in memory.
+class ChunkReader {
+ public:
+  ChunkReader(const std::string&, ChunkQueue&, int32_t);
+
+  void getline(std::string&);
+
+ private:
+  std::ifstream in_;
+  ChunkQueue& queue_;
+  int32_t thread_;
+  std::string buffer_;
+  std::string compressed_;
+  std::size_t pos_;
+
+  void fill();
+  void fillBgzf(const ChunkQueue::Chunk&);
+  bool appendBlock(int64_t&);
+  std::size_t findNewline(std::size_t, int64_t&);
+};
+
+}  // namespace fasttext
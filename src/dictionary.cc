@@ -31,6 +31,27 @@ namespace fasttext {
 constexpr char Dictionary::BOW[];
 constexpr char Dictionary::EOW[];
 
+namespace {
+
+typedef boost::tokenizer<boost::char_separator<char>,
+                         std::string::const_iterator>
+    Tokenizer;
+
+// The tokens of a line are separated by whitespace, as readWord separates
+// them, and start after the weight column when lines have one. Building the
+// dictionary, training and prediction must all split lines the same way.
+Tokenizer tokenize(const std::string& line, bool hasWeight, float& weight) {
+  static const boost::char_separator<char> whitespace(" \t\n\v\f\r");
+  std::size_t p = 0;
+  weight = 1.0f;
+  if (hasWeight) {
+    weight = std::stof(line, &p);
+  }
+  return Tokenizer(line.cbegin() + p, line.cend(), whitespace);
+}
+
+}  // namespace
+
 Dictionary::Dictionary(std::shared_ptr<Args> args)
     : args_(args),
       word2int_(MAX_VOCAB_SIZE, -1),
@@ -96,7 +117,8 @@ const std::vector<int32_t>& Dictionary::getSubwords(int32_t i) const {
 const std::vector<int32_t> Dictionary::getSubwords(
     const std::string& word) const {
   int32_t i = getId(word);
-  if (i >= 0) {
+  // Labels follow the words and have no subwords of their own.
+  if (i >= 0 && i < nwords_) {
     return getSubwords(i);
   }
 
@@ -181,7 +203,10 @@ std::vector<int32_t> Dictionary::computeSubwords(const std::string& word,
   if (max_len > word.size()) {
     max_len = word.size();
   }
-  for (std::string::size_type len = min_len; len <= max_len; ++len) {
+  // -minn 0 (the supervised default) means no empty subwords, and with
+  // -maxn 0 no subwords at all.
+  for (std::string::size_type len = std::max(min_len, 1u); len <= max_len;
+       ++len) {
     for (std::string::size_type start = 0; start <= word.size() - len;
          ++start) {
       std::string subword = word.substr(start, len);
@@ -192,7 +217,7 @@ std::vector<int32_t> Dictionary::computeSubwords(const std::string& word,
         subword += eow;
       }
       int32_t h = hash(subword) % args_->bucket;
-      res.push_back(h);
+      pushHash(res, h);
     }
   }
   return res;
@@ -212,14 +237,8 @@ void Dictionary::readFromFile(std::istream& in) {
   float weight = 1.0f;
 
   while (std::getline(in, cur_line)) {
-    // Special treatment for the first column that may be 'weight'.
-    std::size_t p = 0;
-    if (args_->has_weight) {
-      weight = std::stof(cur_line, &p);
-    }
-    // The rest of the line is a sequence of words.
-    boost::tokenizer<> tok(cur_line.cbegin() + p, cur_line.cend());
-    for (const std::string& word : tok) {
+    for (const std::string& word :
+         tokenize(cur_line, args_->has_weight, weight)) {
       add(word, weight);
       if (ntokens_ % 1000000 == 0 && args_->verbose > 1) {
         std::cerr << "\rRead " << ntokens_ / 1000000 << "M words" << std::flush;
@@ -300,7 +319,9 @@ void Dictionary::addWordNgrams(std::vector<int32_t>& line,
 void Dictionary::addSubwords(std::vector<int32_t>& line,
                              const std::string& token, int32_t wid) const {
   if (wid < 0) {  // out of vocab
-    line = computeSubwords(token, args_->minn, args_->maxn, BOW, EOW);
+    const std::vector<int32_t> ngrams =
+        computeSubwords(token, args_->minn, args_->maxn, BOW, EOW);
+    line.insert(line.end(), ngrams.cbegin(), ngrams.cend());
   } else {
     if (args_->maxn <= 0) {  // in vocab w/o subwords
       line.push_back(wid);
@@ -325,18 +346,8 @@ int32_t Dictionary::convertLine(const std::string& line, std::minstd_rand& rng,
 
   words->clear();
 
-  // Special treatment for the first column that may be 'weight'.
-  std::size_t p = 0;
-  if (args_->has_weight) {
-    *weight = std::stof(line, &p);
-  } else {
-    *weight = 1.0f;
-  }
-
-  // The rest of the line is a sequence of words.
-  boost::tokenizer<> tok(line.cbegin() + p, line.cend());
   int32_t ntokens = 0;
-  for (const std::string& token : tok) {
+  for (const std::string& token : tokenize(line, args_->has_weight, *weight)) {
     int32_t wid = getId(token);
     if (wid < 0) continue;
 
@@ -349,30 +360,33 @@ int32_t Dictionary::convertLine(const std::string& line, std::minstd_rand& rng,
   return ntokens;
 }
 
+// Reads one line, split as in readFromFile; its weight, if any, is skipped.
 int32_t Dictionary::getLine(std::istream& in, std::vector<int32_t>& words,
                             std::vector<int32_t>& labels) const {
   std::vector<int32_t> word_hashes;
-  std::string token;
+  std::string line;
+  float weight;
   int32_t ntokens = 0;
 
-  // reset(in);
-  // words.clear();
-  // labels.clear();
-  // while (readWord(in, token)) {
-  //   uint32_t h = hash(token);
-  //   int32_t wid = getId(token, h);
-  //   entry_type type = wid < 0 ? getType(token) : getType(wid);
-
-  //   ntokens++;
-  //   if (type == entry_type::word) {
-  //     addSubwords(words, token, wid);
-  //     word_hashes.push_back(h);
-  //   } else if (type == entry_type::label && wid >= 0) {
-  //     labels.push_back(wid - nwords_);
-  //   }
-  //   if (token == EOS) break;
-  // }
-  // addWordNgrams(words, word_hashes, args_->wordNgrams);
+  words.clear();
+  labels.clear();
+  if (!std::getline(in, line)) {
+    return 0;
+  }
+  for (const std::string& token : tokenize(line, args_->has_weight, weight)) {
+    uint32_t h = hash(token);
+    int32_t wid = getId(token, h);
+    entry_type type = wid < 0 ? getType(token) : getType(wid);
+
+    ntokens++;
+    if (type == entry_type::word) {
+      addSubwords(words, token, wid);
+      word_hashes.push_back(h);
+    } else if (type == entry_type::label && wid >= 0) {
+      labels.push_back(wid - nwords_);
+    }
+  }
+  addWordNgrams(words, word_hashes, args_->wordNgrams);
   return ntokens;
 }
 
@@ -488,6 +502,7 @@ void Dictionary::prune(std::vector<int32_t>& idx) {
   nwords_ = words.size();
   size_ = nwords_ + nlabels_;
   words_.erase(words_.begin() + size_, words_.end());
+  initTableDiscard();
   initNgrams();
 }
 
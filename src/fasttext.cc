@@ -12,6 +12,7 @@
 #include <algorithm>
 #include <boost/algorithm/string/join.hpp>
 #include <boost/range/adaptor/transformed.hpp>
+#include <functional>
 #include <iomanip>
 #include <iostream>
 #include <numeric>
@@ -21,14 +22,19 @@
 #include <thread>
 #include <vector>
 
-#include "file_reader.hpp"
+#include "affinity.h"
+#include "gzip.h"
+#include "hugepages.h"
 
 namespace fasttext {
 
-constexpr int32_t FASTTEXT_VERSION = 12; /* Version 1b */
+constexpr int32_t FASTTEXT_VERSION = 13; /* Version 1c */
 constexpr int32_t FASTTEXT_FILEFORMAT_MAGIC_INT32 = 793712314;
+// Training threads read the input in chunks of about this many bytes.
+constexpr int64_t TRAIN_CHUNK_BYTES = 1 << 20;
 
-FastText::FastText() : quant_(false) {}
+FastText::FastText()
+    : nnEf_(64), nnThreads_(1), nnRerank_(100), quant_(false) {}
 
 void FastText::addInputVector(Vector& vec, int32_t ind) const {
   if (quant_) {
@@ -38,6 +44,17 @@ void FastText::addInputVector(Vector& vec, int32_t ind) const {
   }
 }
 
+// vec += the input rows of ids, gathered with prefetching; weights, when
+// given, scale each row.
+void FastText::addInputVectors(Vector& vec, const std::vector<int32_t>& ids,
+                               const float* weights) const {
+  if (quant_) {
+    qinput_->sumRows(ids.data(), ids.size(), weights, vec.data());
+  } else {
+    input_->sumRows(ids.data(), ids.size(), weights, vec.data());
+  }
+}
+
 std::shared_ptr<const Dictionary> FastText::getDictionary() const {
   return dict_;
 }
@@ -64,9 +81,7 @@ int32_t FastText::getSubwordId(const std::string& word) const {
 void FastText::getWordVector(Vector& vec, const std::string& word) const {
   const std::vector<int32_t>& ngrams = dict_->getSubwords(word);
   vec.zero();
-  for (int i = 0; i < ngrams.size(); i++) {
-    addInputVector(vec, ngrams[i]);
-  }
+  addInputVectors(vec, ngrams);
   if (ngrams.size() > 0) {
     vec.mul(1.0 / ngrams.size());
   }
@@ -187,6 +202,14 @@ void FastText::loadModel(const std::string& filename) {
   }
   loadModel(ifs);
   ifs.close();
+  printHugePages();
+}
+
+// Reported only when huge pages were asked for with FASTTEXT_HUGEPAGES.
+void FastText::printHugePages() const {
+  if (hugepages::activeMode() != hugepages::mode::off) {
+    std::cerr << hugepages::report() << std::endl;
+  }
 }
 
 void FastText::loadModel(std::istream& in) {
@@ -200,13 +223,20 @@ void FastText::loadModel(std::istream& in) {
     // backward compatibility: old supervised models do not use char ngrams.
     args_->maxn = 0;
   }
+  if (version < 13 && args_->maxn > 0) {
+    // Character n-grams used to share their rows with the words; since
+    // version 13 they follow the words, as word n-grams do.
+    throw std::invalid_argument(
+        "Models with character n-grams saved before version 13 are no "
+        "longer supported, please retrain them.");
+  }
   dict_ = std::make_shared<Dictionary>(args_, in);
 
   bool quant_input;
   in.read((char*)&quant_input, sizeof(quant_input));
   if (quant_input) {
     quant_ = true;
-    qinput_->load(in);
+    qinput_->load(in, version);
   } else {
     input_->load(in);
   }
@@ -220,7 +250,7 @@ void FastText::loadModel(std::istream& in) {
 
   in.read((char*)&args_->qout, sizeof(args_->qout));
   if (quant_ && args_->qout) {
-    qoutput_->load(in);
+    qoutput_->load(in, version);
   } else {
     output_->load(in);
   }
@@ -271,17 +301,38 @@ std::vector<int32_t> FastText::selectEmbeddings(int32_t cutoff) const {
   return idx;
 }
 
+// Ranks the rows of input_ by how often training touches them: a word row
+// by the count of its word, an ngram row by the summed counts of the words
+// it occurs in.
+std::vector<int32_t> FastText::selectEmbeddingsByFrequency(
+    int32_t cutoff) const {
+  std::vector<double> usage(input_->size(0), 0.0);
+  std::vector<float> counts = dict_->getCounts(entry_type::word);
+  for (int32_t i = 0; i < dict_->nwords(); i++) {
+    for (auto row : dict_->getSubwords(i)) {
+      usage[row] += counts[i];
+    }
+  }
+  std::vector<int32_t> idx(input_->size(0), 0);
+  std::iota(idx.begin(), idx.end(), 0);
+  std::stable_sort(idx.begin(), idx.end(), [&usage](size_t i1, size_t i2) {
+    return usage[i1] > usage[i2];
+  });
+  idx.erase(idx.begin() + cutoff, idx.end());
+  return idx;
+}
+
 void FastText::quantize(const Args qargs) {
-  if (args_->model != model_name::sup) {
-    throw std::invalid_argument(
-        "For now we only support quantization of supervised models");
+  if (qargs.qbits != 4 && qargs.qbits != 8) {
+    throw std::invalid_argument("-qbits must be 4 or 8");
   }
   args_->input = qargs.input;
   args_->qout = qargs.qout;
   args_->output = qargs.output;
 
   if (qargs.cutoff > 0 && qargs.cutoff < input_->size(0)) {
-    auto idx = selectEmbeddings(qargs.cutoff);
+    auto idx = qargs.cutoffFreq ? selectEmbeddingsByFrequency(qargs.cutoff)
+                                : selectEmbeddings(qargs.cutoff);
     dict_->prune(idx);
     std::shared_ptr<Matrix> ninput =
         std::make_shared<Matrix>(idx.size(), args_->dim);
@@ -291,6 +342,18 @@ void FastText::quantize(const Args qargs) {
       }
     }
     input_ = ninput;
+    if (args_->model != model_name::sup) {
+      // The output matrix of unsupervised models has one row per word, and
+      // prune() lists the words that are kept first.
+      std::shared_ptr<Matrix> noutput =
+          std::make_shared<Matrix>(dict_->nwords(), args_->dim);
+      for (auto i = 0; i < dict_->nwords(); i++) {
+        for (auto j = 0; j < args_->dim; j++) {
+          noutput->at(i, j) = output_->at(idx[i], j);
+        }
+      }
+      output_ = noutput;
+    }
     if (qargs.retrain) {
       args_->epoch = qargs.epoch;
       args_->lr = qargs.lr;
@@ -300,10 +363,14 @@ void FastText::quantize(const Args qargs) {
     }
   }
 
-  qinput_ = std::make_shared<QMatrix>(*input_, qargs.dsub, qargs.qnorm);
+  qinput_ =
+      std::make_shared<QMatrix>(*input_, qargs.dsub, qargs.qnorm, qargs.thread,
+                                qargs.kmeanspp, qargs.qtol, qargs.qbits);
 
   if (args_->qout) {
-    qoutput_ = std::make_shared<QMatrix>(*output_, 2, qargs.qnorm);
+    qoutput_ =
+        std::make_shared<QMatrix>(*output_, 2, qargs.qnorm, qargs.thread,
+                                  qargs.kmeanspp, qargs.qtol, qargs.qbits);
   }
 
   quant_ = true;
@@ -352,31 +419,90 @@ void FastText::skipgram(Model& model, float lr,
   }
 }
 
+// Reads up to n lines. A single reader stops early once no more input is
+// buffered, so that interactive input is answered line by line.
+static bool readLines(std::istream& in, int64_t n, bool interactive,
+                      std::vector<std::string>& lines) {
+  lines.clear();
+  std::string line;
+  while (lines.size() < n && std::getline(in, line)) {
+    lines.push_back(line);
+    if (interactive && in.rdbuf()->in_avail() <= 0) {
+      break;
+    }
+  }
+  return !lines.empty();
+}
+
+// Runs f(0), ..., f(n - 1), each on its own thread when n > 1.
+static void parallelFor(int32_t n, const std::function<void(int32_t)>& f) {
+  if (n == 1) {
+    affinity::ScopedPin pin("inference", 0);
+    f(0);
+    return;
+  }
+  std::vector<std::thread> threads;
+  for (int32_t i = 0; i < n; i++) {
+    threads.push_back(std::thread([&f, i]() {
+      affinity::pin("inference", i);
+      f(i);
+    }));
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+constexpr int64_t INFERENCE_CHUNK_SIZE = 256;
+
 std::tuple<int64_t, double, double> FastText::test(std::istream& in, int32_t k,
-                                                   float threshold) {
-  int32_t nexamples = 0, nlabels = 0, npredictions = 0;
-  double precision = 0.0;
-  std::vector<int32_t> line, labels;
+                                                   float threshold,
+                                                   int32_t nthreads) const {
+  Meter meter;
+  test(in, k, threshold, meter, nthreads);
+  return std::tuple<int64_t, double, double>(
+      meter.nexamples(), meter.precision(), meter.recall());
+}
 
-  while (in.peek() != EOF) {
-    dict_->getLine(in, line, labels);
-    if (labels.size() > 0 && line.size() > 0) {
-      std::vector<std::pair<float, int32_t>> modelPredictions;
-      model_->predict(line, k, threshold, modelPredictions);
-      for (auto it = modelPredictions.cbegin(); it != modelPredictions.cend();
-           it++) {
-        if (std::find(labels.begin(), labels.end(), it->second) !=
-            labels.end()) {
-          precision += 1.0;
+// Lines are read in rounds of one chunk per thread; each thread parses and
+// predicts its chunk into its own meter, and the meters are added in input
+// order.
+void FastText::test(std::istream& in, int32_t k, float threshold,
+                    Meter& meter, int32_t nthreads) const {
+  nthreads = std::max(nthreads, 1);
+  std::vector<std::string> lines;
+  std::vector<Meter> meters(nthreads);
+  while (readLines(in, INFERENCE_CHUNK_SIZE * nthreads, false, lines)) {
+    const int32_t nchunks =
+        (lines.size() + INFERENCE_CHUNK_SIZE - 1) / INFERENCE_CHUNK_SIZE;
+    parallelFor(nchunks, [&](int32_t c) {
+      const int64_t begin = c * INFERENCE_CHUNK_SIZE;
+      const int64_t end =
+          std::min<int64_t>(begin + INFERENCE_CHUNK_SIZE, lines.size());
+      std::vector<std::vector<int32_t>> inputs, labels;
+      std::vector<int32_t> words, lineLabels;
+      for (int64_t i = begin; i < end; i++) {
+        std::istringstream iss(lines[i]);
+        dict_->getLine(iss, words, lineLabels);
+        if (!lineLabels.empty() && !words.empty()) {
+          inputs.push_back(words);
+          labels.push_back(lineLabels);
         }
       }
-      nexamples++;
-      nlabels += labels.size();
-      npredictions += modelPredictions.size();
+      Matrix hidden(inputs.size(), args_->dim);
+      Matrix output(args_->loss == loss_name::hs ? 0 : inputs.size(),
+                    dict_->nlabels());
+      std::vector<std::vector<std::pair<float, int32_t>>> predictions;
+      model_->predict(inputs, k, threshold, predictions, hidden, output);
+      meters[c] = Meter();
+      for (int64_t i = 0; i < inputs.size(); i++) {
+        meters[c].log(labels[i], predictions[i]);
+      }
+    });
+    for (int32_t c = 0; c < nchunks; c++) {
+      meter.add(meters[c]);
     }
   }
-  return std::tuple<int64_t, double, double>(
-      nexamples, precision / npredictions, precision / nlabels);
 }
 
 void FastText::predict(std::istream& in, int32_t k,
@@ -398,26 +524,78 @@ void FastText::predict(std::istream& in, int32_t k,
   }
 }
 
-void FastText::predict(std::istream& in, int32_t k, bool print_prob,
-                       float threshold) {
-  std::vector<std::pair<float, std::string>> predictions;
-  while (in.peek() != EOF) {
-    predictions.clear();
-    predict(in, k, predictions, threshold);
-    if (predictions.empty()) {
-      std::cout << std::endl;
-      continue;
+// Batched prediction over inputs given as word and n-gram ids, as returned
+// by Dictionary::getLine. The hidden vectors of all inputs form one matrix
+// that is scored against all labels at once.
+void FastText::predict(
+    const std::vector<std::vector<int32_t>>& inputs, int32_t k,
+    std::vector<std::vector<std::pair<float, std::string>>>& predictions,
+    float threshold) const {
+  Matrix hidden(inputs.size(), args_->dim);
+  Matrix output(args_->loss == loss_name::hs ? 0 : inputs.size(),
+                dict_->nlabels());
+  std::vector<std::vector<std::pair<float, int32_t>>> modelPredictions;
+  model_->predict(inputs, k, threshold, modelPredictions, hidden, output);
+  predictions.assign(
+      inputs.size(), std::vector<std::pair<float, std::string>>());
+  for (int64_t i = 0; i < inputs.size(); i++) {
+    for (const auto& prediction : modelPredictions[i]) {
+      predictions[i].push_back(std::make_pair(
+          prediction.first, dict_->getLabel(prediction.second)));
     }
-    for (auto it = predictions.cbegin(); it != predictions.cend(); it++) {
-      if (it != predictions.cbegin()) {
-        std::cout << " ";
-      }
-      std::cout << it->second;
-      if (print_prob) {
-        std::cout << " " << std::exp(it->first);
+  }
+}
+
+void FastText::predict(
+    const std::vector<std::string>& lines, int32_t k,
+    std::vector<std::vector<std::pair<float, std::string>>>& predictions,
+    float threshold) const {
+  std::vector<std::vector<int32_t>> inputs(lines.size());
+  std::vector<int32_t> labels;
+  for (int64_t i = 0; i < lines.size(); i++) {
+    std::istringstream in(lines[i]);
+    dict_->getLine(in, inputs[i], labels);
+  }
+  predict(inputs, k, predictions, threshold);
+}
+
+// Same rounds as test(). Each thread formats the predictions of its chunk
+// into a buffer, and the buffers are written in input order.
+void FastText::predict(std::istream& in, int32_t k, bool print_prob,
+                       float threshold, int32_t nthreads) const {
+  nthreads = std::max(nthreads, 1);
+  std::vector<std::string> lines;
+  std::vector<std::string> outputs(nthreads);
+  while (readLines(in, INFERENCE_CHUNK_SIZE * nthreads, nthreads == 1, lines)) {
+    const int32_t nchunks =
+        (lines.size() + INFERENCE_CHUNK_SIZE - 1) / INFERENCE_CHUNK_SIZE;
+    parallelFor(nchunks, [&](int32_t c) {
+      const int64_t begin = c * INFERENCE_CHUNK_SIZE;
+      const int64_t end =
+          std::min<int64_t>(begin + INFERENCE_CHUNK_SIZE, lines.size());
+      std::vector<std::string> chunk(lines.begin() + begin,
+                                     lines.begin() + end);
+      std::vector<std::vector<std::pair<float, std::string>>> predictions;
+      predict(chunk, k, predictions, threshold);
+      std::ostringstream out;
+      for (const auto& prediction : predictions) {
+        for (auto it = prediction.cbegin(); it != prediction.cend(); it++) {
+          if (it != prediction.cbegin()) {
+            out << " ";
+          }
+          out << it->second;
+          if (print_prob) {
+            out << " " << std::exp(it->first);
+          }
+        }
+        out << "\n";
       }
+      outputs[c] = out.str();
+    });
+    for (int32_t c = 0; c < nchunks; c++) {
+      std::cout << outputs[c];
     }
-    std::cout << std::endl;
+    std::cout.flush();
   }
 }
 
@@ -426,9 +604,7 @@ void FastText::getSentenceVector(std::istream& in, fasttext::Vector& svec) {
   if (args_->model == model_name::sup) {
     std::vector<int32_t> line, labels;
     dict_->getLine(in, line, labels);
-    for (int32_t i = 0; i < line.size(); i++) {
-      addInputVector(svec, line[i]);
-    }
+    addInputVectors(svec, line);
     if (!line.empty()) {
       svec.mul(1.0 / line.size());
     }
@@ -472,11 +648,13 @@ void FastText::ngramVectors(std::string word) {
   }
 }
 
-void FastText::precomputeWordVectors(Matrix& wordVectors) {
+// Fills the rows of wordVectors with the normalized vectors of the words
+// first, first + 1, ...
+void FastText::computeWordVectors(Matrix& wordVectors, int32_t first) const {
   Vector vec(args_->dim);
   wordVectors.zero();
-  for (int32_t i = 0; i < dict_->nwords(); i++) {
-    std::string word = dict_->getWord(i);
+  for (int64_t i = 0; i < wordVectors.rows(); i++) {
+    std::string word = dict_->getWord(first + i);
     getWordVector(vec, word);
     float norm = vec.norm();
     if (norm > 0) {
@@ -485,38 +663,317 @@ void FastText::precomputeWordVectors(Matrix& wordVectors) {
   }
 }
 
+void FastText::precomputeWordVectors(Matrix& wordVectors) {
+  computeWordVectors(wordVectors, 0);
+}
+
+// Normalized word vectors saved once, so that nn and analogies can map them
+// instead of composing every word from its subwords at startup.
+void FastText::saveNNVectors(const std::string& filename,
+                             vector_format format) {
+  Matrix wordVectors(dict_->nwords(), args_->dim);
+  precomputeWordVectors(wordVectors);
+  MappedMatrix::save(filename, wordVectors, format);
+}
+
+std::shared_ptr<const Matrix> FastText::loadNNVectors(
+    const std::string& filename) const {
+  std::shared_ptr<const Matrix> wordVectors = MappedMatrix::load(filename);
+  if (wordVectors->rows() != dict_->nwords() ||
+      wordVectors->cols() != args_->dim) {
+    throw std::invalid_argument(filename + " does not match the model!");
+  }
+  printHugePages();
+  return wordVectors;
+}
+
 void FastText::findNN(const Matrix& wordVectors, const Vector& queryVec,
                       int32_t k, const std::set<std::string>& banSet,
                       std::vector<std::pair<float, std::string>>& results) {
   results.clear();
-  std::priority_queue<std::pair<float, std::string>> heap;
   float queryNorm = queryVec.norm();
   if (std::abs(queryNorm) < 1e-8) {
     queryNorm = 1;
   }
-  Vector vec(args_->dim);
-  for (int32_t i = 0; i < dict_->nwords(); i++) {
-    std::string word = dict_->getWord(i);
-    float dp = wordVectors.dotRow(queryVec, i);
-    heap.push(std::make_pair(dp / queryNorm, word));
+  std::vector<int32_t> banIds;
+  for (const auto& word : banSet) {
+    int32_t id = dict_->getId(word);
+    if (id >= 0) {
+      banIds.push_back(id);
+    }
+  }
+  std::vector<std::pair<float, int32_t>> candidates;
+  if (nnIndex_) {
+    int32_t n = k + banIds.size();
+    nnIndex_->search(wordVectors, queryVec, n, std::max(nnEf_, n),
+                     candidates);
+  } else if (ivfIndex_) {
+    searchIVFIndex(queryVec, k, banIds, candidates);
+  } else {
+    ExactKNN(nnThreads_).search(wordVectors, queryVec, k, banIds, candidates);
   }
-  int32_t i = 0;
-  while (i < k && heap.size() > 0) {
-    auto it = banSet.find(heap.top().second);
-    if (it == banSet.end()) {
+  for (auto it = candidates.cbegin();
+       it != candidates.cend() && results.size() < k; ++it) {
+    if (std::find(banIds.begin(), banIds.end(), it->second) == banIds.end()) {
       results.push_back(
-          std::pair<float, std::string>(heap.top().first, heap.top().second));
-      i++;
+          std::make_pair(it->first / queryNorm, dict_->getWord(it->second)));
     }
-    heap.pop();
   }
 }
 
+// Exact search for a batch of queries, one per row, each with its own list
+// of banned word ids (or none if banIds is empty). Scores are cosine
+// similarities when wordVectors comes from precomputeWordVectors.
+void FastText::findNN(
+    const Matrix& wordVectors, const Matrix& queries, int32_t k,
+    const std::vector<std::vector<int32_t>>& banIds,
+    std::vector<std::vector<std::pair<float, int32_t>>>& results) const {
+  ExactKNN(nnThreads_).search(wordVectors, queries, k, banIds, results);
+  for (int64_t q = 0; q < queries.rows(); q++) {
+    float queryNorm = queries.l2NormRow(q);
+    if (std::abs(queryNorm) < 1e-8) {
+      queryNorm = 1;
+    }
+    for (auto& result : results[q]) {
+      result.first /= queryNorm;
+    }
+  }
+}
+
+void FastText::setNNThreads(int32_t nthreads) { nnThreads_ = nthreads; }
+
+void FastText::buildNNIndex(const Matrix& wordVectors, int32_t M,
+                            int32_t efConstruction, int32_t nthreads) {
+  nnIndex_ = std::make_shared<HNSWIndex>(M, efConstruction);
+  nnIndex_->build(wordVectors, nthreads);
+}
+
+void FastText::saveNNIndex(const std::string& filename) const {
+  if (!nnIndex_) {
+    throw std::invalid_argument("No nearest-neighbour index to save!");
+  }
+  std::ofstream ofs(filename, std::ofstream::binary);
+  if (!ofs.is_open()) {
+    throw std::invalid_argument(filename + " cannot be opened for saving!");
+  }
+  nnIndex_->save(ofs);
+  ofs.close();
+}
+
+void FastText::loadNNIndex(const std::string& filename) {
+  std::ifstream ifs(filename, std::ifstream::binary);
+  if (!ifs.is_open()) {
+    throw std::invalid_argument(filename + " cannot be opened for loading!");
+  }
+  std::shared_ptr<HNSWIndex> index = std::make_shared<HNSWIndex>();
+  index->load(ifs);
+  ifs.close();
+  if (index->size() != dict_->nwords() || index->dim() != args_->dim) {
+    throw std::invalid_argument(filename + " does not match the model!");
+  }
+  nnIndex_ = index;
+}
+
+// Search breadth: ef for the HNSW index, lists probed for the IVF index.
+void FastText::setNNSearchEf(int32_t ef) { nnEf_ = ef; }
+
+// Fraction of the exact k nearest neighbours of nqueries words, spread over
+// the vocabulary, that the index returns with the current search ef.
+float FastText::testNNIndex(const Matrix& wordVectors, int32_t k,
+                            int32_t nqueries) const {
+  if (!nnIndex_) {
+    throw std::invalid_argument("No nearest-neighbour index to test!");
+  }
+  const int32_t nwords = dict_->nwords();
+  nqueries = std::min(nqueries, nwords);
+  Matrix queries(nqueries, args_->dim);
+  for (int32_t q = 0; q < nqueries; q++) {
+    const int32_t id = int64_t(q) * nwords / nqueries;
+    std::copy(wordVectors.row(id), wordVectors.row(id) + args_->dim,
+              queries.row(q));
+  }
+  std::vector<std::vector<std::pair<float, int32_t>>> exact;
+  ExactKNN(nnThreads_).search(wordVectors, queries, k, {}, exact);
+  Vector query(args_->dim);
+  std::vector<std::pair<float, int32_t>> approx;
+  int64_t found = 0, total = 0;
+  for (int32_t q = 0; q < nqueries; q++) {
+    std::copy(queries.row(q), queries.row(q) + args_->dim, query.data());
+    const int32_t kq = exact[q].size();
+    nnIndex_->search(wordVectors, query, kq, std::max(nnEf_, kq), approx);
+    for (const auto& e : exact[q]) {
+      for (const auto& a : approx) {
+        if (a.second == e.second) {
+          found++;
+          break;
+        }
+      }
+    }
+    total += kq;
+  }
+  return total > 0 ? float(found) / total : 0.0;
+}
+
+// Scans nnEf_ lists of the IVF-PQ index, then re-scores the best nnRerank_
+// candidates with the word vectors computed from the model.
+void FastText::searchIVFIndex(
+    const Vector& query, int32_t k, const std::vector<int32_t>& banIds,
+    std::vector<std::pair<float, int32_t>>& results) const {
+  const int32_t n = std::max(k, nnRerank_) + banIds.size();
+  ivfIndex_->search(query, n, nnEf_, results);
+  if (nnRerank_ > 0) {
+    Vector vec(args_->dim);
+    for (auto& result : results) {
+      getWordVector(vec, dict_->getWord(result.second));
+      float norm = vec.norm();
+      float dp = 0.0;
+      for (int32_t j = 0; j < args_->dim; j++) {
+        dp += query[j] * vec[j];
+      }
+      result.first = norm > 0 ? dp / norm : 0.0;
+    }
+    std::sort(
+        results.begin(),
+        results.end(),
+        [](const std::pair<float, int32_t>& a,
+           const std::pair<float, int32_t>& b) {
+          return a.first > b.first ||
+              (a.first == b.first && a.second < b.second);
+        });
+  }
+  auto banned = [&banIds](const std::pair<float, int32_t>& r) {
+    return std::find(banIds.begin(), banIds.end(), r.second) != banIds.end();
+  };
+  results.erase(
+      std::remove_if(results.begin(), results.end(), banned), results.end());
+  if (results.size() > k) {
+    results.resize(k);
+  }
+}
+
+// The index is built from the word vectors computed in chunks, so that the
+// dense matrix of all word vectors is never allocated.
+void FastText::buildIVFIndex(int32_t nlist, int32_t dsub, int32_t nbits,
+                             int32_t nthreads) {
+  const int32_t nwords = dict_->nwords();
+  const int32_t nsample = std::min<int64_t>(
+      nwords, std::max<int64_t>(int64_t(nlist) * 64, 65536));
+  Matrix sample(nsample, args_->dim);
+  sample.zero();
+  Vector vec(args_->dim);
+  for (int32_t i = 0; i < nsample; i++) {
+    getWordVector(vec, dict_->getWord(int64_t(i) * nwords / nsample));
+    float norm = vec.norm();
+    if (norm > 0) {
+      sample.addRow(vec, i, 1.0 / norm);
+    }
+  }
+  ivfIndex_ = std::make_shared<IVFPQIndex>(args_->dim, nlist, dsub, nbits);
+  ivfIndex_->train(sample, nthreads);
+  const int32_t chunk = 65536;
+  for (int32_t first = 0; first < nwords; first += chunk) {
+    Matrix wordVectors(std::min(chunk, nwords - first), args_->dim);
+    computeWordVectors(wordVectors, first);
+    ivfIndex_->add(wordVectors, first, nthreads);
+  }
+}
+
+void FastText::saveIVFIndex(const std::string& filename) const {
+  if (!ivfIndex_) {
+    throw std::invalid_argument("No nearest-neighbour index to save!");
+  }
+  std::ofstream ofs(filename, std::ofstream::binary);
+  if (!ofs.is_open()) {
+    throw std::invalid_argument(filename + " cannot be opened for saving!");
+  }
+  ivfIndex_->save(ofs);
+  ofs.close();
+}
+
+void FastText::loadIVFIndex(const std::string& filename) {
+  std::ifstream ifs(filename, std::ifstream::binary);
+  if (!ifs.is_open()) {
+    throw std::invalid_argument(filename + " cannot be opened for loading!");
+  }
+  ivfIndex_ = std::make_shared<IVFPQIndex>();
+  ivfIndex_->load(ifs);
+  ifs.close();
+  if (ivfIndex_->size() != dict_->nwords()) {
+    ivfIndex_.reset();
+    throw std::invalid_argument(filename + " does not match the model!");
+  }
+}
+
+bool FastText::hasIVFIndex() const { return bool(ivfIndex_); }
+
+void FastText::setNNRerank(int32_t rerank) { nnRerank_ = rerank; }
+
+// Same measure as testNNIndex, with the exact neighbours found over chunks
+// of the vocabulary.
+float FastText::testIVFIndex(int32_t k, int32_t nqueries) const {
+  if (!ivfIndex_) {
+    throw std::invalid_argument("No nearest-neighbour index to test!");
+  }
+  const int32_t nwords = dict_->nwords();
+  nqueries = std::min(nqueries, nwords);
+  Matrix queries(nqueries, args_->dim);
+  queries.zero();
+  Vector query(args_->dim);
+  for (int32_t q = 0; q < nqueries; q++) {
+    getWordVector(query, dict_->getWord(int64_t(q) * nwords / nqueries));
+    float norm = query.norm();
+    if (norm > 0) {
+      queries.addRow(query, q, 1.0 / norm);
+    }
+  }
+  std::vector<std::vector<std::pair<float, int32_t>>> exact(nqueries), part;
+  const int32_t chunk = 65536;
+  for (int32_t first = 0; first < nwords; first += chunk) {
+    Matrix wordVectors(std::min(chunk, nwords - first), args_->dim);
+    computeWordVectors(wordVectors, first);
+    ExactKNN(nnThreads_).search(wordVectors, queries, k, {}, part);
+    for (int32_t q = 0; q < nqueries; q++) {
+      for (const auto& p : part[q]) {
+        exact[q].push_back(std::make_pair(p.first, first + p.second));
+      }
+    }
+  }
+  std::vector<std::pair<float, int32_t>> approx;
+  int64_t found = 0, total = 0;
+  for (int32_t q = 0; q < nqueries; q++) {
+    std::sort(
+        exact[q].begin(),
+        exact[q].end(),
+        [](const std::pair<float, int32_t>& a,
+           const std::pair<float, int32_t>& b) {
+          return a.first > b.first ||
+              (a.first == b.first && a.second < b.second);
+        });
+    const int32_t kq = std::min<int64_t>(k, exact[q].size());
+    std::copy(queries.row(q), queries.row(q) + args_->dim, query.data());
+    searchIVFIndex(query, kq, {}, approx);
+    for (int32_t i = 0; i < kq; i++) {
+      for (const auto& a : approx) {
+        if (a.second == exact[q][i].second) {
+          found++;
+          break;
+        }
+      }
+    }
+    total += kq;
+  }
+  return total > 0 ? float(found) / total : 0.0;
+}
+
 void FastText::analogies(int32_t k) {
-  std::string word;
-  Vector buffer(args_->dim), query(args_->dim);
   Matrix wordVectors(dict_->nwords(), args_->dim);
   precomputeWordVectors(wordVectors);
+  analogies(k, wordVectors);
+}
+
+void FastText::analogies(int32_t k, const Matrix& wordVectors) {
+  std::string word;
+  Vector buffer(args_->dim), query(args_->dim);
   std::set<std::string> banSet;
   std::cout << "Query triplet (A - B + C)? ";
   std::vector<std::pair<float, std::string>> results;
@@ -545,13 +1002,7 @@ void FastText::analogies(int32_t k) {
 }
 
 void FastText::trainThread(int32_t threadId) {
-  std::ifstream ifs(args_->input);
-  auto file_size = utils::size(ifs);
-  ifs.close();
-
-  FileReader input(args_->input, threadId * file_size / args_->thread,
-                   (threadId + 1) * file_size / args_->thread);
-
+  ChunkReader input(args_->input, *chunks_, threadId);
   std::string cur_line;
   float weight;
 
@@ -568,21 +1019,18 @@ void FastText::trainThread(int32_t threadId) {
   while (tokenCount_ < args_->epoch * ntokens) {
     float progress = float(tokenCount_) / (args_->epoch * ntokens);
     float lr = args_->lr * (1.0 - progress);
+    input.getline(cur_line);
     if (args_->model == model_name::sup) {
-      localTokenCount += dict_->getLine(ifs, line, labels);
+      std::istringstream iss(cur_line);
+      localTokenCount += dict_->getLine(iss, line, labels);
       supervised(model, lr, line, labels);
     } else if (args_->model == model_name::cbow) {
-      input.getline(&cur_line);
       localTokenCount +=
           dict_->convertLine(cur_line, model.rng, &line, &weight);
       cbow(model, lr, line);
     } else if (args_->model == model_name::sg) {
-      input.getline(&cur_line);
       localTokenCount +=
           dict_->convertLine(cur_line, model.rng, &line, &weight);
-      // for (auto ww : line)
-      //   std::cout << dict_->getWord(ww) << " ";
-      // std::cout << weight << " " << localTokenCount << std::endl;
       skipgram(model, lr, line, weight);
     }
     if (localTokenCount > args_->lrUpdateRate) {
@@ -592,7 +1040,6 @@ void FastText::trainThread(int32_t threadId) {
     }
   }
   if (threadId == 0) loss_ = model.getLoss();
-  ifs.close();
 }
 
 void FastText::loadVectors(std::string filename) {
@@ -647,7 +1094,14 @@ void FastText::train(const Args args) {
     throw std::invalid_argument(args_->input +
                                 " cannot be opened for training!");
   }
-  dict_->readFromFile(ifs);
+  if (gzip::isGzip(args_->input)) {
+    gzip::Streambuf buffer(args_->input);
+    std::istream in(&buffer);
+    in.exceptions(std::istream::badbit);
+    dict_->readFromFile(in);
+  } else {
+    dict_->readFromFile(ifs);
+  }
   ifs.close();
 
   if (args_->pretrainedVectors.size() != 0) {
@@ -664,6 +1118,9 @@ void FastText::train(const Args args) {
     output_ = std::make_shared<Matrix>(dict_->nwords(), args_->dim);
   }
   output_->zero();
+  if (args_->verbose > 0) {
+    printHugePages();
+  }
   model_ = std::make_shared<Model>(input_, output_, args_, 0);
   if (args_->model == model_name::sup) {
     model_->setTargetCounts(dict_->getCounts(entry_type::label));
@@ -677,9 +1134,14 @@ void FastText::startThreads() {
   start_ = clock();
   tokenCount_ = 0;
   loss_ = -1;
+  chunks_ = std::make_shared<ChunkQueue>(args_->input, args_->thread,
+                                         TRAIN_CHUNK_BYTES, 0);
   std::vector<std::thread> threads;
   for (int32_t i = 0; i < args_->thread; i++) {
-    threads.push_back(std::thread([=]() { trainThread(i); }));
+    threads.push_back(std::thread([=]() {
+      affinity::pin("train", i);
+      trainThread(i);
+    }));
   }
   const int64_t ntokens = dict_->ntokens();
   // Same condition as trainThread
@@ -694,6 +1156,7 @@ void FastText::startThreads() {
   for (int32_t i = 0; i < args_->thread; i++) {
     threads[i].join();
   }
+  chunks_.reset();
   if (args_->verbose > 0) {
     std::cerr << "\r";
     printInfo(1.0, loss_, std::cerr);
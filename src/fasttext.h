@@ -20,8 +20,14 @@
 #include <tuple>
 
 #include "args.h"
+#include "chunkqueue.h"
 #include "dictionary.h"
+#include "hnsw.h"
+#include "ivfpq.h"
+#include "knn.h"
+#include "mappedmatrix.h"
 #include "matrix.h"
+#include "meter.h"
 #include "model.h"
 #include "qmatrix.h"
 #include "utils.h"
@@ -42,6 +48,13 @@ class FastText {
 
   std::shared_ptr<Model> model_;
 
+  std::shared_ptr<HNSWIndex> nnIndex_;
+  int32_t nnEf_;
+  int32_t nnThreads_;
+  std::shared_ptr<IVFPQIndex> ivfIndex_;
+  int32_t nnRerank_;
+
+  std::shared_ptr<ChunkQueue> chunks_;
   std::atomic<int64_t> tokenCount_;
   std::atomic<float> loss_;
 
@@ -53,6 +66,10 @@ class FastText {
   int32_t version;
 
   void startThreads();
+  void printHugePages() const;
+  void computeWordVectors(Matrix&, int32_t) const;
+  void searchIVFIndex(const Vector&, int32_t, const std::vector<int32_t>&,
+                      std::vector<std::pair<float, int32_t>>&) const;
 
  public:
   FastText();
@@ -65,6 +82,8 @@ class FastText {
   void getWordVector(Vector&, const std::string&) const;
   void getSubwordVector(Vector&, const std::string&) const;
   void addInputVector(Vector&, int32_t) const;
+  void addInputVectors(Vector&, const std::vector<int32_t>&,
+                       const float* weights = nullptr) const;
   inline void getInputVector(Vector& vec, int32_t ind) {
     vec.zero();
     addInputVector(vec, ind);
@@ -87,18 +106,45 @@ class FastText {
   void cbow(Model&, float, const std::vector<int32_t>&);
   void skipgram(Model&, float, const std::vector<int32_t>&, float);
   std::vector<int32_t> selectEmbeddings(int32_t) const;
+  std::vector<int32_t> selectEmbeddingsByFrequency(int32_t) const;
   void getSentenceVector(std::istream&, Vector&);
   void quantize(const Args);
-  std::tuple<int64_t, double, double> test(std::istream&, int32_t, float = 0.0);
-  void predict(std::istream&, int32_t, bool, float = 0.0);
+  std::tuple<int64_t, double, double> test(std::istream&, int32_t, float = 0.0,
+                                           int32_t = 1) const;
+  void test(std::istream&, int32_t, float, Meter&, int32_t = 1) const;
+  void predict(std::istream&, int32_t, bool, float = 0.0, int32_t = 1) const;
   void predict(std::istream&, int32_t,
                std::vector<std::pair<float, std::string>>&, float = 0.0) const;
+  void predict(const std::vector<std::vector<int32_t>>&, int32_t,
+               std::vector<std::vector<std::pair<float, std::string>>>&,
+               float = 0.0) const;
+  void predict(const std::vector<std::string>&, int32_t,
+               std::vector<std::vector<std::pair<float, std::string>>>&,
+               float = 0.0) const;
   void ngramVectors(std::string);
   void precomputeWordVectors(Matrix&);
+  void saveNNVectors(const std::string&, vector_format);
+  std::shared_ptr<const Matrix> loadNNVectors(const std::string&) const;
   void findNN(const Matrix&, const Vector&, int32_t,
               const std::set<std::string>&,
               std::vector<std::pair<float, std::string>>& results);
+  void findNN(const Matrix&, const Matrix&, int32_t,
+              const std::vector<std::vector<int32_t>>&,
+              std::vector<std::vector<std::pair<float, int32_t>>>&) const;
+  void setNNThreads(int32_t);
+  void buildNNIndex(const Matrix&, int32_t, int32_t, int32_t);
+  void saveNNIndex(const std::string&) const;
+  void loadNNIndex(const std::string&);
+  void setNNSearchEf(int32_t);
+  float testNNIndex(const Matrix&, int32_t, int32_t) const;
+  void buildIVFIndex(int32_t, int32_t, int32_t, int32_t);
+  void saveIVFIndex(const std::string&) const;
+  void loadIVFIndex(const std::string&);
+  bool hasIVFIndex() const;
+  void setNNRerank(int32_t);
+  float testIVFIndex(int32_t, int32_t) const;
   void analogies(int32_t);
+  void analogies(int32_t, const Matrix&);
   void trainThread(int32_t);
   void train(const Args);
 
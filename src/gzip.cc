@@ -0,0 +1,132 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "gzip.h"
+
+#include <fstream>
+#include <stdexcept>
+
+namespace fasttext {
+
+namespace gzip {
+
+namespace {
+
+constexpr std::size_t STREAM_BUFFER_SIZE = 1 << 20;
+
+}  // namespace
+
+bool isGzip(const std::string& filename) {
+  std::ifstream in(filename, std::ifstream::binary);
+  unsigned char magic[2];
+  if (!in.read(reinterpret_cast<char*>(magic), 2)) {
+    return false;
+  }
+  return magic[0] == 0x1f && magic[1] == 0x8b;
+}
+
+// The extra field of a BGZF header holds a single "BC" subfield with the
+// block size minus one, as every BGZF writer lays it out.
+int64_t bgzfBlockSize(const unsigned char* header) {
+  if (header[0] != 0x1f || header[1] != 0x8b || header[2] != 8 ||
+      (header[3] & 4) == 0 || header[10] != 6 || header[11] != 0 ||
+      header[12] != 'B' || header[13] != 'C' || header[14] != 2 ||
+      header[15] != 0) {
+    return -1;
+  }
+  return int64_t(header[16] | (header[17] << 8)) + 1;
+}
+
+std::vector<int64_t> bgzfBounds(const std::string& filename,
+                                int64_t chunkSize) {
+  std::ifstream in(filename, std::ifstream::binary);
+  in.seekg(0, std::ifstream::end);
+  const int64_t size = in.tellg();
+  std::vector<int64_t> bounds(1, 0);
+  int64_t offset = 0;
+  unsigned char header[BGZF_HEADER_SIZE];
+  while (offset < size) {
+    in.seekg(offset);
+    int64_t block = -1;
+    if (in.read(reinterpret_cast<char*>(header), BGZF_HEADER_SIZE)) {
+      block = bgzfBlockSize(header);
+    }
+    if (block < 0) {
+      if (offset == 0) {
+        return {};
+      }
+      throw std::invalid_argument(filename + " is not a valid BGZF file!");
+    }
+    offset += block;
+    if (offset - bounds.back() >= chunkSize && offset < size) {
+      bounds.push_back(offset);
+    }
+  }
+  if (offset != size) {
+    throw std::invalid_argument(filename + " is truncated!");
+  }
+  bounds.push_back(size);
+  return bounds;
+}
+
+void inflateMembers(const char* data, std::size_t size, std::string& out) {
+  z_stream stream = z_stream();
+  // 16 + MAX_WBITS: gzip headers only.
+  if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK) {
+    throw std::runtime_error("Cannot initialize zlib.");
+  }
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+  stream.avail_in = size;
+  char buffer[1 << 16];
+  while (true) {
+    stream.next_out = reinterpret_cast<Bytef*>(buffer);
+    stream.avail_out = sizeof(buffer);
+    const int status = inflate(&stream, Z_NO_FLUSH);
+    out.append(buffer, sizeof(buffer) - stream.avail_out);
+    if (status == Z_STREAM_END) {
+      if (stream.avail_in == 0) {
+        break;
+      }
+      inflateReset(&stream);
+    } else if (status != Z_OK ||
+               (stream.avail_in == 0 && stream.avail_out > 0)) {
+      inflateEnd(&stream);
+      throw std::runtime_error("Corrupt or truncated gzip data.");
+    }
+  }
+  inflateEnd(&stream);
+}
+
+Streambuf::Streambuf(const std::string& filename)
+    : file_(gzopen(filename.c_str(), "rb")), buffer_(STREAM_BUFFER_SIZE) {
+  if (file_ == nullptr) {
+    throw std::invalid_argument(filename + " cannot be opened for reading!");
+  }
+  gzbuffer(file_, STREAM_BUFFER_SIZE);
+}
+
+Streambuf::~Streambuf() { gzclose(file_); }
+
+Streambuf::int_type Streambuf::underflow() {
+  const int n = gzread(file_, buffer_.data(), buffer_.size());
+  int status = Z_OK;
+  gzerror(file_, &status);
+  if (n < 0 || (n == 0 && status != Z_OK)) {
+    throw std::runtime_error("Corrupt or truncated gzip data.");
+  }
+  if (n == 0) {
+    return traits_type::eof();
+  }
+  setg(buffer_.data(), buffer_.data(), buffer_.data() + n);
+  return traits_type::to_int_type(buffer_[0]);
+}
+
+}  // namespace gzip
+
+}  // namespace fasttext
@@ -0,0 +1,62 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <zlib.h>
+
+#include <cstdint>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+namespace fasttext {
+
+// Reading of gzip-compressed training files. A plain gzip file is one
+// stream and can only be inflated from its start. A BGZF file, as written by
+// bgzip, is a series of gzip blocks of at most 64KB that each record their
+// own compressed size; it is still a valid gzip file, and it can be inflated
+// from any block, so training threads inflate their own chunks of it.
+namespace gzip {
+
+// Bytes of a BGZF block header, up to and including its size field.
+constexpr std::size_t BGZF_HEADER_SIZE = 18;
+
+// Whether the file starts with the gzip magic bytes.
+bool isGzip(const std::string& filename);
+
+// Compressed size of the BGZF block whose first BGZF_HEADER_SIZE bytes are
+// header, or -1 if it is not one.
+int64_t bgzfBlockSize(const unsigned char* header);
+
+// Offsets of BGZF blocks at least chunkSize bytes apart, starting with 0 and
+// ending with the file size; empty if the file is not BGZF.
+std::vector<int64_t> bgzfBounds(const std::string& filename, int64_t chunkSize);
+
+// Inflates the gzip members stored one after the other in
+// [data, data + size) and appends them to out.
+void inflateMembers(const char* data, std::size_t size, std::string& out);
+
+// Sequential reads of a gzip file (or of a plain one, as is).
+class Streambuf : public std::streambuf {
+ public:
+  explicit Streambuf(const std::string& filename);
+  ~Streambuf();
+
+ protected:
+  int_type underflow() override;
+
+ private:
+  gzFile file_;
+  std::vector<char> buffer_;
+};
+
+}  // namespace gzip
+
+}  // namespace fasttext
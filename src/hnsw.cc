@@ -0,0 +1,392 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "hnsw.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <queue>
+#include <stdexcept>
+#include <thread>
+
+#include "affinity.h"
+#include "kernels.h"
+
+namespace fasttext {
+
+constexpr int32_t HNSW_FILEFORMAT_MAGIC_INT32 = 1213093719;
+constexpr int32_t HNSW_VERSION = 1;
+
+static inline float dotProduct(const float* x, const float* y, int32_t d) {
+  return kernels::dot(x, y, d);
+}
+
+HNSWIndex::HNSWIndex() : HNSWIndex(16, 200) {}
+
+HNSWIndex::HNSWIndex(int32_t M, int32_t efConstruction)
+    : dim_(0),
+      M_(M),
+      maxM0_(2 * M),
+      efConstruction_(efConstruction),
+      n_(0),
+      maxLevel_(-1),
+      entry_(-1) {
+  if (M_ < 2) {
+    throw std::invalid_argument("HNSW index needs M >= 2");
+  }
+}
+
+int32_t* HNSWIndex::getLinks(int32_t node, int32_t level) {
+  if (level == 0) {
+    return &links0_[int64_t(node) * (maxM0_ + 1)];
+  }
+  return &links_[node][(level - 1) * (M_ + 1)];
+}
+
+const int32_t* HNSWIndex::getLinks(int32_t node, int32_t level) const {
+  if (level == 0) {
+    return &links0_[int64_t(node) * (maxM0_ + 1)];
+  }
+  return &links_[node][(level - 1) * (M_ + 1)];
+}
+
+std::unique_ptr<HNSWIndex::VisitedList> HNSWIndex::acquireVisited() const {
+  std::unique_ptr<VisitedList> visited;
+  {
+    std::lock_guard<std::mutex> lock(visitedMutex_);
+    if (!visitedPool_.empty()) {
+      visited = std::move(visitedPool_.back());
+      visitedPool_.pop_back();
+    }
+  }
+  if (!visited) {
+    visited = std::unique_ptr<VisitedList>(new VisitedList());
+    visited->tags.assign(n_, 0);
+    visited->tag = 0;
+  }
+  visited->tag++;
+  if (visited->tag == 0) {
+    std::fill(visited->tags.begin(), visited->tags.end(), 0);
+    visited->tag = 1;
+  }
+  return visited;
+}
+
+void HNSWIndex::releaseVisited(std::unique_ptr<VisitedList> visited) const {
+  std::lock_guard<std::mutex> lock(visitedMutex_);
+  visitedPool_.push_back(std::move(visited));
+}
+
+// Walks from ep towards q on the levels above target, following the best
+// neighbour until no neighbour improves the score.
+int32_t HNSWIndex::greedySearch(const Matrix& vectors, const float* q,
+                                int32_t ep, int32_t from, int32_t target,
+                                bool locked) const {
+  float score = dotProduct(q, vectors.row(ep), dim_);
+  std::vector<int32_t> neighbors;
+  for (int32_t level = from; level > target; level--) {
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      {
+        std::unique_lock<std::mutex> lock;
+        if (locked) {
+          lock = std::unique_lock<std::mutex>(nodeMutex_[ep]);
+        }
+        const int32_t* links = getLinks(ep, level);
+        neighbors.assign(links + 1, links + 1 + links[0]);
+      }
+      for (auto nb : neighbors) {
+        float s = dotProduct(q, vectors.row(nb), dim_);
+        if (s > score) {
+          score = s;
+          ep = nb;
+          changed = true;
+        }
+      }
+    }
+  }
+  return ep;
+}
+
+void HNSWIndex::searchLayer(
+    const Matrix& vectors, const float* q, int32_t ep, int32_t ef,
+    int32_t level, bool locked,
+    std::vector<std::pair<float, int32_t>>& result) const {
+  typedef std::pair<float, int32_t> Candidate;
+  std::unique_ptr<VisitedList> visited = acquireVisited();
+  const uint16_t tag = visited->tag;
+  std::priority_queue<Candidate> candidates;
+  std::priority_queue<Candidate, std::vector<Candidate>,
+                      std::greater<Candidate>>
+      top;
+  float s = dotProduct(q, vectors.row(ep), dim_);
+  candidates.push(std::make_pair(s, ep));
+  top.push(std::make_pair(s, ep));
+  visited->tags[ep] = tag;
+
+  std::vector<int32_t> neighbors;
+  while (!candidates.empty()) {
+    const Candidate c = candidates.top();
+    if (c.first < top.top().first && top.size() >= ef) {
+      break;
+    }
+    candidates.pop();
+    {
+      std::unique_lock<std::mutex> lock;
+      if (locked) {
+        lock = std::unique_lock<std::mutex>(nodeMutex_[c.second]);
+      }
+      const int32_t* links = getLinks(c.second, level);
+      neighbors.assign(links + 1, links + 1 + links[0]);
+    }
+    for (auto nb : neighbors) {
+      if (visited->tags[nb] == tag) {
+        continue;
+      }
+      visited->tags[nb] = tag;
+      s = dotProduct(q, vectors.row(nb), dim_);
+      if (top.size() < ef || s > top.top().first) {
+        candidates.push(std::make_pair(s, nb));
+        top.push(std::make_pair(s, nb));
+        if (top.size() > ef) {
+          top.pop();
+        }
+      }
+    }
+  }
+  releaseVisited(std::move(visited));
+
+  result.clear();
+  while (!top.empty()) {
+    result.push_back(top.top());
+    top.pop();
+  }
+  std::reverse(result.begin(), result.end());
+}
+
+// Keeps at most m candidates, skipping those closer to an already selected
+// neighbour than to the query, so that links spread in all directions.
+void HNSWIndex::selectNeighbors(
+    const Matrix& vectors, std::vector<std::pair<float, int32_t>>& candidates,
+    int32_t m) const {
+  if (candidates.size() <= m) {
+    return;
+  }
+  std::sort(candidates.begin(), candidates.end(),
+            std::greater<std::pair<float, int32_t>>());
+  std::vector<std::pair<float, int32_t>> selected;
+  for (const auto& c : candidates) {
+    if (selected.size() >= m) {
+      break;
+    }
+    bool good = true;
+    const float* x = vectors.row(c.second);
+    for (const auto& s : selected) {
+      if (dotProduct(x, vectors.row(s.second), dim_) > c.first) {
+        good = false;
+        break;
+      }
+    }
+    if (good) {
+      selected.push_back(c);
+    }
+  }
+  candidates.swap(selected);
+}
+
+void HNSWIndex::connect(const Matrix& vectors, int32_t node, int32_t nb,
+                        int32_t level) {
+  const int32_t maxM = (level == 0) ? maxM0_ : M_;
+  std::lock_guard<std::mutex> lock(nodeMutex_[nb]);
+  int32_t* links = getLinks(nb, level);
+  if (links[0] < maxM) {
+    links[++links[0]] = node;
+    return;
+  }
+  const float* x = vectors.row(nb);
+  std::vector<std::pair<float, int32_t>> candidates;
+  candidates.push_back(
+      std::make_pair(dotProduct(x, vectors.row(node), dim_), node));
+  for (int32_t j = 1; j <= links[0]; j++) {
+    candidates.push_back(
+        std::make_pair(dotProduct(x, vectors.row(links[j]), dim_), links[j]));
+  }
+  selectNeighbors(vectors, candidates, maxM);
+  links[0] = candidates.size();
+  for (int32_t j = 0; j < candidates.size(); j++) {
+    links[j + 1] = candidates[j].second;
+  }
+}
+
+void HNSWIndex::insert(const Matrix& vectors, int32_t node) {
+  const int32_t level = levels_[node];
+  std::unique_lock<std::mutex> global(globalMutex_);
+  const int32_t maxLevel = maxLevel_;
+  int32_t ep = entry_;
+  if (ep < 0) {
+    entry_ = node;
+    maxLevel_ = level;
+    return;
+  }
+  if (level <= maxLevel) {
+    global.unlock();
+  }
+
+  const float* q = vectors.row(node);
+  ep = greedySearch(vectors, q, ep, maxLevel, level, true);
+  std::vector<std::pair<float, int32_t>> neighbors;
+  for (int32_t l = std::min(level, maxLevel); l >= 0; l--) {
+    searchLayer(vectors, q, ep, efConstruction_, l, true, neighbors);
+    ep = neighbors[0].second;
+    selectNeighbors(vectors, neighbors, M_);
+    {
+      std::lock_guard<std::mutex> lock(nodeMutex_[node]);
+      int32_t* links = getLinks(node, l);
+      links[0] = neighbors.size();
+      for (int32_t j = 0; j < neighbors.size(); j++) {
+        links[j + 1] = neighbors[j].second;
+      }
+    }
+    for (const auto& nb : neighbors) {
+      connect(vectors, node, nb.second, l);
+    }
+  }
+  if (level > maxLevel) {
+    entry_ = node;
+    maxLevel_ = level;
+  }
+}
+
+void HNSWIndex::build(const Matrix& vectors, int32_t nthreads) {
+  n_ = vectors.size(0);
+  dim_ = vectors.size(1);
+  entry_ = -1;
+  maxLevel_ = -1;
+  visitedPool_.clear();
+  std::minstd_rand rng(seed_);
+  std::uniform_real_distribution<> uniform(0.0, 1.0);
+  const double mult = 1.0 / std::log(double(M_));
+  levels_.resize(n_);
+  links0_.assign(int64_t(n_) * (maxM0_ + 1), 0);
+  links_.assign(n_, std::vector<int32_t>());
+  for (int32_t i = 0; i < n_; i++) {
+    levels_[i] = int32_t(-std::log(1.0 - uniform(rng)) * mult);
+    if (levels_[i] > 0) {
+      links_[i].assign(levels_[i] * (M_ + 1), 0);
+    }
+  }
+  if (n_ == 0) {
+    return;
+  }
+  nodeMutex_.reset(new std::mutex[n_]);
+  insert(vectors, 0);
+  std::atomic<int32_t> next(1);
+  auto worker = [&]() {
+    for (int32_t i = next++; i < n_; i = next++) {
+      insert(vectors, i);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int32_t t = 1; t < nthreads; t++) {
+    threads.push_back(std::thread([&, t]() {
+      affinity::pin("hnsw", t);
+      worker();
+    }));
+  }
+  {
+    affinity::ScopedPin pin("hnsw", 0);
+    worker();
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  nodeMutex_.reset();
+}
+
+void HNSWIndex::search(const Matrix& vectors, const Vector& query, int32_t k,
+                       int32_t ef,
+                       std::vector<std::pair<float, int32_t>>& results) const {
+  assert(query.size() == dim_);
+  assert(vectors.size(0) == n_);
+  results.clear();
+  if (n_ == 0) {
+    return;
+  }
+  const int32_t ep =
+      greedySearch(vectors, query.data(), entry_, maxLevel_, 0, false);
+  searchLayer(vectors, query.data(), ep, std::max(ef, k), 0, false, results);
+  if (results.size() > k) {
+    results.resize(k);
+  }
+}
+
+int32_t HNSWIndex::size() const { return n_; }
+
+int32_t HNSWIndex::dim() const { return dim_; }
+
+void HNSWIndex::save(std::ostream& out) const {
+  const int32_t magic = HNSW_FILEFORMAT_MAGIC_INT32;
+  const int32_t version = HNSW_VERSION;
+  out.write((char*)&magic, sizeof(magic));
+  out.write((char*)&version, sizeof(version));
+  out.write((char*)&dim_, sizeof(dim_));
+  out.write((char*)&M_, sizeof(M_));
+  out.write((char*)&maxM0_, sizeof(maxM0_));
+  out.write((char*)&efConstruction_, sizeof(efConstruction_));
+  out.write((char*)&n_, sizeof(n_));
+  out.write((char*)&maxLevel_, sizeof(maxLevel_));
+  out.write((char*)&entry_, sizeof(entry_));
+  out.write((char*)levels_.data(), n_ * sizeof(*levels_.data()));
+  out.write((char*)links0_.data(), links0_.size() * sizeof(*links0_.data()));
+  for (int32_t i = 0; i < n_; i++) {
+    out.write((char*)links_[i].data(),
+              links_[i].size() * sizeof(*links_[i].data()));
+  }
+}
+
+void HNSWIndex::load(std::istream& in) {
+  int32_t magic, version;
+  in.read((char*)&magic, sizeof(magic));
+  in.read((char*)&version, sizeof(version));
+  if (magic != HNSW_FILEFORMAT_MAGIC_INT32 || version > HNSW_VERSION) {
+    throw std::invalid_argument("Invalid nearest-neighbour index file");
+  }
+  in.read((char*)&dim_, sizeof(dim_));
+  in.read((char*)&M_, sizeof(M_));
+  in.read((char*)&maxM0_, sizeof(maxM0_));
+  in.read((char*)&efConstruction_, sizeof(efConstruction_));
+  in.read((char*)&n_, sizeof(n_));
+  in.read((char*)&maxLevel_, sizeof(maxLevel_));
+  in.read((char*)&entry_, sizeof(entry_));
+  if (!in || n_ < 0 || M_ < 0 || maxM0_ < 0) {
+    throw std::invalid_argument("Invalid nearest-neighbour index file");
+  }
+  levels_.resize(n_);
+  in.read((char*)levels_.data(), n_ * sizeof(*levels_.data()));
+  links0_.resize(int64_t(n_) * (maxM0_ + 1));
+  in.read((char*)links0_.data(), links0_.size() * sizeof(*links0_.data()));
+  links_.assign(n_, std::vector<int32_t>());
+  for (int32_t i = 0; i < n_ && in; i++) {
+    if (levels_[i] < 0 || levels_[i] > maxLevel_) {
+      throw std::invalid_argument("Invalid nearest-neighbour index file");
+    }
+    links_[i].resize(levels_[i] * (M_ + 1));
+    in.read((char*)links_[i].data(),
+            links_[i].size() * sizeof(*links_[i].data()));
+  }
+  if (!in) {
+    throw std::invalid_argument("Truncated nearest-neighbour index file");
+  }
+  visitedPool_.clear();
+}
+
+}  // namespace fasttext
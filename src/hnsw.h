@@ -0,0 +1,87 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "matrix.h"
+#include "vector.h"
+
+namespace fasttext {
+
+// Hierarchical navigable small world graph over the rows of a matrix of
+// normalized vectors, searched by inner product. The index only stores the
+// graph: the vectors are passed to build() and search().
+class HNSWIndex {
+ protected:
+  struct VisitedList {
+    std::vector<uint16_t> tags;
+    uint16_t tag;
+  };
+
+  const int32_t seed_ = 4242;
+
+  int32_t dim_;
+  int32_t M_;
+  int32_t maxM0_;
+  int32_t efConstruction_;
+  int32_t n_;
+  int32_t maxLevel_;
+  int32_t entry_;
+
+  std::vector<int32_t> levels_;
+  // Level 0 has maxM0_ slots per node, upper levels M_: each list starts
+  // with its number of neighbours.
+  std::vector<int32_t> links0_;
+  std::vector<std::vector<int32_t>> links_;
+
+  std::unique_ptr<std::mutex[]> nodeMutex_;
+  std::mutex globalMutex_;
+  mutable std::mutex visitedMutex_;
+  mutable std::vector<std::unique_ptr<VisitedList>> visitedPool_;
+
+  int32_t* getLinks(int32_t, int32_t);
+  const int32_t* getLinks(int32_t, int32_t) const;
+  std::unique_ptr<VisitedList> acquireVisited() const;
+  void releaseVisited(std::unique_ptr<VisitedList>) const;
+
+  int32_t greedySearch(const Matrix&, const float*, int32_t, int32_t, int32_t,
+                       bool) const;
+  void searchLayer(const Matrix&, const float*, int32_t, int32_t, int32_t,
+                   bool, std::vector<std::pair<float, int32_t>>&) const;
+  void selectNeighbors(const Matrix&, std::vector<std::pair<float, int32_t>>&,
+                       int32_t) const;
+  void connect(const Matrix&, int32_t, int32_t, int32_t);
+  void insert(const Matrix&, int32_t);
+
+ public:
+  HNSWIndex();
+  HNSWIndex(int32_t, int32_t);
+  HNSWIndex(const HNSWIndex&) = delete;
+  HNSWIndex& operator=(const HNSWIndex&) = delete;
+
+  void build(const Matrix&, int32_t);
+  void search(const Matrix&, const Vector&, int32_t, int32_t,
+              std::vector<std::pair<float, int32_t>>&) const;
+  int32_t size() const;
+  int32_t dim() const;
+
+  void save(std::ostream&) const;
+  void load(std::istream&);
+};
+
+}  // namespace fasttext
@@ -0,0 +1,205 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "hugepages.h"
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <mutex>
+
+namespace fasttext {
+
+namespace hugepages {
+
+namespace {
+
+struct Region {
+  std::size_t size;
+  // Mapped with MAP_HUGETLB: every page is a huge page.
+  bool reserved;
+};
+
+std::mutex& regionsMutex() {
+  static std::mutex m;
+  return m;
+}
+
+// Buffers handed out by allocate, by start address.
+std::map<uintptr_t, Region>& regions() {
+  static std::map<uintptr_t, Region> r;
+  return r;
+}
+
+mode chooseMode() {
+  const char* env = std::getenv("FASTTEXT_HUGEPAGES");
+  if (env == nullptr) {
+    return mode::off;
+  }
+  for (int32_t i = 0; i <= int32_t(mode::hugetlb); i++) {
+    if (modeName(mode(i)) == env) {
+      return mode(i);
+    }
+  }
+  return mode::off;
+}
+
+std::string formatBytes(double bytes) {
+  const char* units = "BKMGT";
+  int32_t u = 0;
+  while (bytes >= 1024 && u < 4) {
+    bytes /= 1024;
+    u++;
+  }
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), u == 0 ? "%.0f%c" : "%.1f%c", bytes,
+           units[u]);
+  return buffer;
+}
+
+}  // namespace
+
+mode activeMode() {
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+  static const mode active = chooseMode();
+  return active;
+#else
+  return mode::off;
+#endif
+}
+
+std::string modeName(mode m) {
+  switch (m) {
+    case mode::off:
+      return "off";
+    case mode::thp:
+      return "thp";
+    case mode::hugetlb:
+      return "hugetlb";
+  }
+  return "unknown";
+}
+
+void* allocate(std::size_t bytes) {
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+  const mode m = activeMode();
+  if (m == mode::off || bytes < HUGE_PAGE_SIZE) {
+    return nullptr;
+  }
+  const std::size_t size =
+      (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+  void* p = MAP_FAILED;
+  bool reserved = false;
+#if defined(MAP_HUGETLB)
+  if (m == mode::hugetlb) {
+    p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    reserved = p != MAP_FAILED;
+  }
+#endif
+  if (p == MAP_FAILED) {
+    // One huge page more than needed, so that the buffer can start on a
+    // huge page boundary; the slack on both sides is unmapped.
+    char* q = static_cast<char*>(mmap(nullptr, size + HUGE_PAGE_SIZE,
+                                      PROT_READ | PROT_WRITE,
+                                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (q == MAP_FAILED) {
+      return nullptr;
+    }
+    char* start = reinterpret_cast<char*>(
+        (reinterpret_cast<uintptr_t>(q) + HUGE_PAGE_SIZE - 1) &
+        ~uintptr_t(HUGE_PAGE_SIZE - 1));
+    if (start > q) {
+      munmap(q, start - q);
+    }
+    munmap(start + size, q + HUGE_PAGE_SIZE - start);
+    madvise(start, size, MADV_HUGEPAGE);
+    p = start;
+  }
+  std::lock_guard<std::mutex> guard(regionsMutex());
+  regions()[reinterpret_cast<uintptr_t>(p)] = Region{size, reserved};
+  return p;
+#else
+  return nullptr;
+#endif
+}
+
+bool release(void* p) {
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+  if (activeMode() == mode::off) {
+    return false;
+  }
+  std::lock_guard<std::mutex> guard(regionsMutex());
+  auto it = regions().find(reinterpret_cast<uintptr_t>(p));
+  if (it == regions().end()) {
+    return false;
+  }
+  munmap(p, it->second.size);
+  regions().erase(it);
+  return true;
+#else
+  return false;
+#endif
+}
+
+// Transparent huge pages are counted from the AnonHugePages lines of
+// /proc/self/smaps, for the parts of each mapping that lie in a buffer.
+std::string report() {
+  const mode m = activeMode();
+  if (m == mode::off) {
+    return "huge pages: off";
+  }
+  std::lock_guard<std::mutex> guard(regionsMutex());
+  const std::map<uintptr_t, Region>& r = regions();
+  std::size_t total = 0, huge = 0;
+  for (const auto& region : r) {
+    total += region.second.size;
+    if (region.second.reserved) {
+      huge += region.second.size;
+    }
+  }
+  std::ifstream smaps("/proc/self/smaps");
+  std::string line;
+  std::size_t overlap = 0;
+  while (std::getline(smaps, line)) {
+    unsigned long start, end;
+    if (sscanf(line.c_str(), "%lx-%lx ", &start, &end) == 2) {
+      overlap = 0;
+      for (const auto& region : r) {
+        if (region.second.reserved) {
+          continue;
+        }
+        const uintptr_t lo = std::max<uintptr_t>(region.first, start);
+        const uintptr_t hi =
+            std::min<uintptr_t>(region.first + region.second.size, end);
+        if (lo < hi) {
+          overlap += hi - lo;
+        }
+      }
+      continue;
+    }
+    unsigned long kb;
+    if (overlap > 0 &&
+        sscanf(line.c_str(), "AnonHugePages: %lu kB", &kb) == 1) {
+      huge += std::min<std::size_t>(overlap, std::size_t(kb) << 10);
+    }
+  }
+  return "huge pages (" + modeName(m) + "): " + formatBytes(huge) + " of " +
+      formatBytes(total) + " in " + std::to_string(r.size()) + " buffers";
+}
+
+}  // namespace hugepages
+
+}  // namespace fasttext
@@ -0,0 +1,46 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace fasttext {
+
+// Huge pages behind the large buffers of Matrix and Vector, to cut the TLB
+// misses of random row accesses. Chosen with the FASTTEXT_HUGEPAGES
+// environment variable: off (the default), thp (transparent huge pages,
+// requested with madvise) or hugetlb (reserved huge pages, falling back to
+// thp when none are left).
+namespace hugepages {
+
+enum class mode : int32_t { off = 0, thp, hugetlb };
+
+// Buffers smaller than this are left to the regular allocator.
+constexpr std::size_t HUGE_PAGE_SIZE = std::size_t(2) << 20;
+
+mode activeMode();
+std::string modeName(mode);
+
+// Zeroed memory for bytes, aligned to HUGE_PAGE_SIZE, or nullptr when huge
+// pages are off, not supported, or not worth it for that size.
+void* allocate(std::size_t);
+// Frees p if it came from allocate, and returns whether it did.
+bool release(void*);
+
+// How much of the memory from allocate is backed by huge pages, e.g.
+// "huge pages (thp): 3.9G of 4.0G in 2 buffers". Transparent huge pages
+// are only put in place as the memory is first written.
+std::string report();
+
+}  // namespace hugepages
+
+}  // namespace fasttext
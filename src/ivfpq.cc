@@ -0,0 +1,246 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "ivfpq.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+
+#include "knn.h"
+
+namespace fasttext {
+
+constexpr int32_t IVFPQ_FILEFORMAT_MAGIC_INT32 = 1230391888;
+constexpr int32_t IVFPQ_VERSION = 1;
+
+IVFPQIndex::IVFPQIndex() : IVFPQIndex(0, 1, 2) {}
+
+IVFPQIndex::IVFPQIndex(int32_t dim, int32_t nlist, int32_t dsub, int32_t nbits)
+    : dim_(dim), nlist_(nlist), dsub_(dsub), nbits_(nbits), ntotal_(0) {
+  if (nlist_ < 1 || dsub_ < 1) {
+    throw std::invalid_argument("IVF-PQ index needs nlist >= 1, dsub >= 1");
+  }
+  if (nbits_ != 4 && nbits_ != 8) {
+    throw std::invalid_argument("IVF-PQ codes must have 4 or 8 bits");
+  }
+}
+
+// Nearest centroid of every row by inner product.
+void IVFPQIndex::assign(const Matrix& x, std::vector<int32_t>& lists,
+                        int32_t nthreads) const {
+  std::vector<std::vector<std::pair<float, int32_t>>> nearest;
+  ExactKNN(nthreads).search(*centroids_, x, 1, {}, nearest);
+  lists.resize(x.rows());
+  for (int64_t i = 0; i < x.rows(); i++) {
+    lists[i] = nearest[i].empty() ? 0 : nearest[i][0].second;
+  }
+}
+
+void IVFPQIndex::residuals(const Matrix& x, const std::vector<int32_t>& lists,
+                           std::vector<float>& res) const {
+  res.resize(x.rows() * dim_);
+  for (int64_t i = 0; i < x.rows(); i++) {
+    const float* xi = x.row(i);
+    const float* c = centroids_->row(lists[i]);
+    for (int32_t j = 0; j < dim_; j++) {
+      res[i * dim_ + j] = xi[j] - c[j];
+    }
+  }
+}
+
+// Spherical k-means for the coarse centroids, then product quantization of
+// the residuals of the same rows.
+void IVFPQIndex::train(const Matrix& x, int32_t nthreads) {
+  const int64_t n = x.rows();
+  dim_ = x.cols();
+  if (n < nlist_ || n < 256) {
+    throw std::invalid_argument(
+        "Too few vectors to train the IVF-PQ index, need at least " +
+        std::to_string(std::max(nlist_, 256)));
+  }
+  std::minstd_rand rng(seed_);
+  std::vector<int64_t> perm(n);
+  std::iota(perm.begin(), perm.end(), 0);
+  std::shuffle(perm.begin(), perm.end(), rng);
+  centroids_.reset(new Matrix(nlist_, dim_));
+  for (int32_t c = 0; c < nlist_; c++) {
+    std::copy(x.row(perm[c]), x.row(perm[c]) + dim_, centroids_->row(c));
+  }
+  std::vector<int32_t> lists;
+  std::vector<int64_t> counts(nlist_);
+  std::uniform_int_distribution<int64_t> randomRow(0, n - 1);
+  for (int32_t it = 0; it < niter_; it++) {
+    assign(x, lists, nthreads);
+    centroids_->zero();
+    std::fill(counts.begin(), counts.end(), 0);
+    for (int64_t i = 0; i < n; i++) {
+      float* c = centroids_->row(lists[i]);
+      const float* xi = x.row(i);
+      for (int32_t j = 0; j < dim_; j++) {
+        c[j] += xi[j];
+      }
+      counts[lists[i]]++;
+    }
+    for (int32_t c = 0; c < nlist_; c++) {
+      float* cc = centroids_->row(c);
+      if (counts[c] == 0) {
+        const float* xi = x.row(randomRow(rng));
+        std::copy(xi, xi + dim_, cc);
+      }
+      float norm = 0.0;
+      for (int32_t j = 0; j < dim_; j++) {
+        norm += cc[j] * cc[j];
+      }
+      norm = std::sqrt(norm);
+      for (int32_t j = 0; j < dim_ && norm > 0; j++) {
+        cc[j] /= norm;
+      }
+    }
+  }
+  assign(x, lists, nthreads);
+  std::vector<float> res;
+  residuals(x, lists, res);
+  pq_.reset(new ProductQuantizer(dim_, dsub_, nbits_));
+  pq_->train(n, res.data(), nthreads);
+  ids_.assign(nlist_, std::vector<int32_t>());
+  codes_.assign(nlist_, std::vector<uint8_t>());
+  ntotal_ = 0;
+}
+
+// Adds the rows of x with ids firstId, firstId + 1, ...
+void IVFPQIndex::add(const Matrix& x, int32_t firstId, int32_t nthreads) {
+  if (!pq_) {
+    throw std::invalid_argument("IVF-PQ index must be trained before adding");
+  }
+  if (x.cols() != dim_) {
+    throw std::invalid_argument("Vectors do not match the IVF-PQ index!");
+  }
+  const int64_t n = x.rows();
+  std::vector<int32_t> lists;
+  assign(x, lists, nthreads);
+  std::vector<float> res;
+  residuals(x, lists, res);
+  std::vector<uint8_t> codes(pq_->code_size(n));
+  pq_->compute_codes(res.data(), codes.data(), n, nthreads);
+  // Codes are copied one subquantizer at a time, since 4-bit codes are
+  // packed by blocks of rows that differ between the batch and the lists.
+  const int32_t nsubq = pq_->get_nsubq();
+  for (int64_t i = 0; i < n; i++) {
+    const int32_t l = lists[i];
+    const int32_t r = ids_[l].size();
+    ids_[l].push_back(firstId + i);
+    codes_[l].resize(pq_->code_size(r + 1), 0);
+    for (int32_t m = 0; m < nsubq; m++) {
+      pq_->set_code(codes_[l].data(), r, m, pq_->get_code(codes.data(), i, m));
+    }
+  }
+  ntotal_ += n;
+}
+
+void IVFPQIndex::search(const Vector& query, int32_t k, int32_t nprobe,
+                        std::vector<std::pair<float, int32_t>>& results) const {
+  results.clear();
+  if (!pq_ || k <= 0) {
+    return;
+  }
+  std::vector<std::pair<float, int32_t>> probes;
+  ExactKNN().search(*centroids_, query, std::min(nprobe, nlist_), {}, probes);
+  std::vector<float> table(pq_->get_table_size());
+  pq_->compute_ip_table(query, table.data());
+  auto better = [](const std::pair<float, int32_t>& a,
+                  const std::pair<float, int32_t>& b) {
+    return a.first > b.first || (a.first == b.first && a.second < b.second);
+  };
+  std::vector<float> scores;
+  for (const auto& probe : probes) {
+    const int32_t l = probe.second;
+    const int32_t size = ids_[l].size();
+    scores.resize(size);
+    pq_->mulcodes(table.data(), codes_[l].data(), size, scores.data());
+    for (int32_t i = 0; i < size; i++) {
+      const float s = probe.first + scores[i];
+      if (results.size() == k && s <= results.front().first) {
+        continue;
+      }
+      if (results.size() == k) {
+        std::pop_heap(results.begin(), results.end(), better);
+        results.pop_back();
+      }
+      results.push_back(std::make_pair(s, ids_[l][i]));
+      std::push_heap(results.begin(), results.end(), better);
+    }
+  }
+  std::sort_heap(results.begin(), results.end(), better);
+}
+
+int64_t IVFPQIndex::size() const { return ntotal_; }
+
+int32_t IVFPQIndex::nlist() const { return nlist_; }
+
+int32_t IVFPQIndex::nbits() const { return nbits_; }
+
+void IVFPQIndex::save(std::ostream& out) const {
+  if (!pq_) {
+    throw std::invalid_argument("IVF-PQ index is not trained!");
+  }
+  const int32_t magic = IVFPQ_FILEFORMAT_MAGIC_INT32;
+  const int32_t version = IVFPQ_VERSION;
+  out.write((char*)&magic, sizeof(magic));
+  out.write((char*)&version, sizeof(version));
+  out.write((char*)&dim_, sizeof(dim_));
+  out.write((char*)&nlist_, sizeof(nlist_));
+  out.write((char*)&dsub_, sizeof(dsub_));
+  out.write((char*)&nbits_, sizeof(nbits_));
+  out.write((char*)&ntotal_, sizeof(ntotal_));
+  for (int32_t c = 0; c < nlist_; c++) {
+    out.write((char*)centroids_->row(c), dim_ * sizeof(float));
+  }
+  pq_->save(out);
+  for (int32_t l = 0; l < nlist_; l++) {
+    const int32_t size = ids_[l].size();
+    out.write((char*)&size, sizeof(size));
+    out.write((char*)ids_[l].data(), size * sizeof(*ids_[l].data()));
+    out.write((char*)codes_[l].data(), codes_[l].size());
+  }
+}
+
+void IVFPQIndex::load(std::istream& in) {
+  int32_t magic, version;
+  in.read((char*)&magic, sizeof(magic));
+  in.read((char*)&version, sizeof(version));
+  if (magic != IVFPQ_FILEFORMAT_MAGIC_INT32 || version > IVFPQ_VERSION) {
+    throw std::invalid_argument("Invalid nearest-neighbour index file");
+  }
+  in.read((char*)&dim_, sizeof(dim_));
+  in.read((char*)&nlist_, sizeof(nlist_));
+  in.read((char*)&dsub_, sizeof(dsub_));
+  in.read((char*)&nbits_, sizeof(nbits_));
+  in.read((char*)&ntotal_, sizeof(ntotal_));
+  centroids_.reset(new Matrix(nlist_, dim_));
+  for (int32_t c = 0; c < nlist_; c++) {
+    in.read((char*)centroids_->row(c), dim_ * sizeof(float));
+  }
+  pq_.reset(new ProductQuantizer());
+  pq_->load(in, nbits_);
+  ids_.assign(nlist_, std::vector<int32_t>());
+  codes_.assign(nlist_, std::vector<uint8_t>());
+  for (int32_t l = 0; l < nlist_; l++) {
+    int32_t size;
+    in.read((char*)&size, sizeof(size));
+    ids_[l].resize(size);
+    codes_[l].resize(pq_->code_size(size));
+    in.read((char*)ids_[l].data(), size * sizeof(*ids_[l].data()));
+    in.read((char*)codes_[l].data(), codes_[l].size());
+  }
+}
+
+}  // namespace fasttext
@@ -0,0 +1,71 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+#include "matrix.h"
+#include "productquantizer.h"
+#include "vector.h"
+
+namespace fasttext {
+
+// Inverted file over normalized vectors: each vector is assigned to the
+// coarse centroid with the highest inner product, and the residual to that
+// centroid is stored as a product quantization code in the centroid's list.
+// A query scans the lists of its nprobe closest centroids, scoring every
+// code with one inner-product table shared by all lists. Only the codes and
+// ids are kept, not the vectors themselves. With 4-bit codes, the codes of
+// a list are packed in blocks of 16 rows and scanned with the fast-scan
+// kernel.
+class IVFPQIndex {
+ protected:
+  const int32_t seed_ = 4343;
+  const int32_t niter_ = 20;
+
+  int32_t dim_;
+  int32_t nlist_;
+  int32_t dsub_;
+  int32_t nbits_;
+  int64_t ntotal_;
+
+  std::unique_ptr<Matrix> centroids_;
+  std::unique_ptr<ProductQuantizer> pq_;
+  std::vector<std::vector<int32_t>> ids_;
+  std::vector<std::vector<uint8_t>> codes_;
+
+  void assign(const Matrix&, std::vector<int32_t>&, int32_t) const;
+  void residuals(const Matrix&, const std::vector<int32_t>&,
+                 std::vector<float>&) const;
+
+ public:
+  IVFPQIndex();
+  IVFPQIndex(int32_t, int32_t, int32_t, int32_t nbits = 8);
+  IVFPQIndex(const IVFPQIndex&) = delete;
+  IVFPQIndex& operator=(const IVFPQIndex&) = delete;
+
+  void train(const Matrix&, int32_t);
+  void add(const Matrix&, int32_t, int32_t);
+  void search(const Vector&, int32_t, int32_t,
+              std::vector<std::pair<float, int32_t>>&) const;
+  int64_t size() const;
+  int32_t nlist() const;
+  int32_t nbits() const;
+
+  void save(std::ostream&) const;
+  void load(std::istream&);
+};
+
+}  // namespace fasttext
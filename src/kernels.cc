@@ -0,0 +1,182 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "kernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+namespace fasttext {
+
+namespace kernels {
+
+// Reference kernels, compiled for the baseline instruction set: the
+// vector type is a single float.
+namespace scalar {
+
+typedef float F;
+typedef int32_t I;
+typedef bool M;
+constexpr int32_t LANES = 1;
+
+static inline F load(const float* x) { return *x; }
+static inline void store(float* x, F v) { *x = v; }
+static inline F set1(float v) { return v; }
+static inline I set1i(int32_t v) { return v; }
+static inline F add(F a, F b) { return a + b; }
+static inline F sub(F a, F b) { return a - b; }
+static inline F mul(F a, F b) { return a * b; }
+static inline F div(F a, F b) { return a / b; }
+static inline F fmadd(F a, F b, F c) { return a * b + c; }
+static inline F fnmadd(F a, F b, F c) { return c - a * b; }
+static inline F vmax(F a, F b) { return std::max(a, b); }
+static inline F vmin(F a, F b) { return std::min(a, b); }
+static inline F vfloor(F a) { return std::floor(a); }
+static inline I toInt(F a) { return I(std::nearbyint(a)); }
+static inline F toFloat(I a) { return F(a); }
+static inline I asInt(F a) {
+  I i;
+  std::memcpy(&i, &a, sizeof(i));
+  return i;
+}
+static inline F asFloat(I a) {
+  F f;
+  std::memcpy(&f, &a, sizeof(f));
+  return f;
+}
+static inline I iadd(I a, I b) { return a + b; }
+static inline I isub(I a, I b) { return a - b; }
+static inline I iand(I a, I b) { return a & b; }
+static inline I ior(I a, I b) { return a | b; }
+static inline I imax(I a, I b) { return std::max(a, b); }
+static inline I shl23(I a) { return I(uint32_t(a) << 23); }
+static inline I shr23(I a) { return I(uint32_t(a) >> 23); }
+static inline M cmplt(F a, F b) { return a < b; }
+static inline M cmpge(F a, F b) { return a >= b; }
+static inline M cmpnan(F a) { return std::isnan(a); }
+static inline F select(M m, F a, F b) { return m ? a : b; }
+static inline uint32_t bits(M m) { return m; }
+static inline float hsum(F v) { return v; }
+static inline float hmax(F v) { return v; }
+
+#include "kernels_impl.h"
+
+}  // namespace scalar
+
+const KernelOps& scalarOps() { return scalar::kOps; }
+
+isa detectIsa() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    return isa::avx512;
+  }
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    return isa::avx2;
+  }
+  if (__builtin_cpu_supports("sse4.2")) {
+    return isa::sse42;
+  }
+#endif
+  return isa::scalar;
+}
+
+static isa chooseIsa() {
+  const isa best = detectIsa();
+  const char* env = std::getenv("FASTTEXT_ISA");
+  if (env == nullptr) {
+    return best;
+  }
+  for (int32_t i = 0; i <= int32_t(isa::avx512); i++) {
+    if (isaName(isa(i)) == env) {
+      return isa(std::min(i, int32_t(best)));
+    }
+  }
+  return best;
+}
+
+isa activeIsa() {
+  static const isa active = chooseIsa();
+  return active;
+}
+
+std::string isaName(isa i) {
+  switch (i) {
+    case isa::scalar:
+      return "scalar";
+    case isa::sse42:
+      return "sse4.2";
+    case isa::avx2:
+      return "avx2";
+    case isa::avx512:
+      return "avx512";
+  }
+  return "unknown";
+}
+
+static const KernelOps& opsFor(isa i) {
+  switch (i) {
+    case isa::sse42:
+      return sse42Ops();
+    case isa::avx2:
+      return avx2Ops();
+    case isa::avx512:
+      return avx512Ops();
+    default:
+      return scalarOps();
+  }
+}
+
+const KernelOps& ops() {
+  static const KernelOps& active = opsFor(activeIsa());
+  return active;
+}
+
+float sigmoid(float x) { return 1.0 / (1.0 + std::exp(-x)); }
+
+// Values per LogSumExp step: the block maximum is taken over this many
+// values, which are then exponentiated while still in L1.
+constexpr int64_t LSE_BLOCK = 64;
+
+void LogSumExp::add(const float* x, int64_t n) {
+  const KernelOps& k = ops();
+  for (int64_t i = 0; i < n; i += LSE_BLOCK) {
+    const int64_t len = std::min(LSE_BLOCK, n - i);
+    const float bmax = k.max(x + i, len);
+    if (bmax == -std::numeric_limits<float>::infinity()) {
+      continue;
+    }
+    if (bmax > max) {
+      sum *= std::exp(max - bmax);
+      max = bmax;
+    }
+    sum += k.sumExp(x + i, len, max);
+  }
+}
+
+// Folds in the values seen by other, as if they had been added here.
+void LogSumExp::merge(const LogSumExp& other) {
+  if (other.max == -std::numeric_limits<float>::infinity()) {
+    return;
+  }
+  if (other.max > max) {
+    sum = sum * std::exp(max - other.max) + other.sum;
+    max = other.max;
+  } else {
+    sum += other.sum * std::exp(other.max - max);
+  }
+}
+
+float LogSumExp::value() const { return max + std::log(sum); }
+
+}  // namespace kernels
+
+}  // namespace fasttext
@@ -0,0 +1,150 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace fasttext {
+
+namespace kernels {
+
+// Instruction sets the kernels are compiled for. The best one supported by
+// the CPU is picked on first use; the FASTTEXT_ISA environment variable
+// (scalar, sse4.2, avx2 or avx512) can lower that choice.
+enum class isa : int32_t { scalar = 0, sse42, avx2, avx512 };
+
+// One implementation of every kernel, for a given instruction set.
+struct KernelOps {
+  float (*dot)(const float*, const float*, int64_t);
+  void (*axpy)(float, const float*, float*, int64_t);
+  void (*scale)(float, float*, int64_t);
+  void (*axpy2)(float, const float*, float*, float*, int64_t);
+  float (*distL2)(const float*, const float*, int64_t);
+  void (*sumRows)(const float*, int64_t, const int32_t*, int64_t, const float*,
+                  int64_t, float*);
+  void (*tile)(const float* const*, const float*, int64_t, int64_t, float*);
+  void (*pqScan8)(const float*, const uint8_t*, int32_t, int32_t, int32_t,
+                  float*);
+  void (*pqScan4)(const uint8_t*, const uint8_t*, int32_t, int32_t, float,
+                  float, float*);
+  float (*max)(const float*, int64_t);
+  float (*sumExp)(const float*, int64_t, float);
+  void (*expShift)(float*, int64_t, float);
+  void (*sigmoid)(float*, int64_t);
+  void (*log)(float*, int64_t);
+  void (*topK)(const float*, int64_t, int32_t, float,
+               std::vector<std::pair<float, int32_t>>&);
+};
+
+const KernelOps& scalarOps();
+const KernelOps& sse42Ops();
+const KernelOps& avx2Ops();
+const KernelOps& avx512Ops();
+
+isa detectIsa();
+isa activeIsa();
+std::string isaName(isa);
+const KernelOps& ops();
+
+// Queries and rows scored together by tile().
+constexpr int32_t TILE_ROWS = 4;
+constexpr int32_t TILE_COLS = 16;
+
+// Ids sumRows looks ahead to prefetch the rows it is about to add.
+constexpr int64_t SUM_ROWS_AHEAD = 8;
+
+inline float dot(const float* x, const float* y, int64_t n) {
+  return ops().dot(x, y, n);
+}
+
+// y += a * x.
+inline void axpy(float a, const float* x, float* y, int64_t n) {
+  ops().axpy(a, x, y, n);
+}
+
+// z += a * y, then y += a * x, in one pass over y.
+inline void axpy2(float a, const float* x, float* y, float* z, int64_t n) {
+  ops().axpy2(a, x, y, z, n);
+}
+
+// x *= a.
+inline void scale(float a, float* x, int64_t n) { ops().scale(a, x, n); }
+
+inline float distL2(const float* x, const float* y, int64_t n) {
+  return ops().distL2(x, y, n);
+}
+
+// out += the sum of weights[k] times row ids[k] of base, for count rows of
+// n floats, stride floats apart. A null weights weighs every row by one.
+inline void sumRows(const float* base, int64_t stride, const int32_t* ids,
+                    int64_t count, const float* weights, int64_t n,
+                    float* out) {
+  ops().sumRows(base, stride, ids, count, weights, n, out);
+}
+
+// acc[i * TILE_COLS + r] = dot(a[i], column r of packed) for TILE_ROWS rows
+// of a and TILE_COLS columns of packed, which holds d rows of stride floats.
+inline void tile(const float* const* a, const float* packed, int64_t d,
+                 int64_t stride, float* acc) {
+  ops().tile(a, packed, d, stride, acc);
+}
+
+// out[i] = sum over m of table[m * ksub + codes[i * nsubq + m]], for n
+// 8-bit product quantization codes.
+inline void pqScan8(const float* table, const uint8_t* codes, int32_t n,
+                    int32_t nsubq, int32_t ksub, float* out) {
+  ops().pqScan8(table, codes, n, nsubq, ksub, out);
+}
+
+// out[i] = inv * (sum of the byte table entries of code i) + bias, for n
+// 4-bit codes packed in blocks of 16 rows with npairs bytes per row.
+inline void pqScan4(const uint8_t* lut, const uint8_t* codes, int32_t n,
+                    int32_t npairs, float inv, float bias, float* out) {
+  ops().pqScan4(lut, codes, n, npairs, inv, bias, out);
+}
+
+// Running log(sum(exp(x))) over blocks of values, kept as the maximum seen
+// so far and the sum of exp(x - max): each block is scanned once, and the
+// sum is only rescaled when a block raises the maximum.
+struct LogSumExp {
+  float max = -std::numeric_limits<float>::infinity();
+  float sum = 0.0;
+
+  void add(const float*, int64_t);
+  void merge(const LogSumExp&);
+  float value() const;
+};
+
+// x[i] = exp(x[i] - shift).
+inline void expShift(float* x, int64_t n, float shift) {
+  ops().expShift(x, n, shift);
+}
+
+// x[i] = 1 / (1 + exp(-x[i])).
+inline void sigmoid(float* x, int64_t n) { ops().sigmoid(x, n); }
+float sigmoid(float);
+
+// x[i] = log(x[i]) for positive x[i].
+inline void log(float* x, int64_t n) { ops().log(x, n); }
+
+// Keeps in heap, a min-heap ordered by Model::comparePairs, the k largest
+// values of x that are at least cutoff, paired with their indices.
+inline void topK(const float* x, int64_t n, int32_t k, float cutoff,
+                 std::vector<std::pair<float, int32_t>>& heap) {
+  ops().topK(x, n, k, cutoff, heap);
+}
+
+}  // namespace kernels
+
+}  // namespace fasttext
@@ -0,0 +1,88 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+// AVX2 kernels, compiled with -mavx2 -mfma.
+
+#include "kernels.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#endif
+
+namespace fasttext {
+
+namespace kernels {
+
+#if defined(__AVX2__) && defined(__FMA__)
+
+namespace avx2 {
+
+typedef __m256 F;
+typedef __m256i I;
+typedef __m256 M;
+constexpr int32_t LANES = 8;
+
+static inline F load(const float* x) { return _mm256_loadu_ps(x); }
+static inline void store(float* x, F v) { _mm256_storeu_ps(x, v); }
+static inline F set1(float v) { return _mm256_set1_ps(v); }
+static inline I set1i(int32_t v) { return _mm256_set1_epi32(v); }
+static inline F add(F a, F b) { return _mm256_add_ps(a, b); }
+static inline F sub(F a, F b) { return _mm256_sub_ps(a, b); }
+static inline F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+static inline F div(F a, F b) { return _mm256_div_ps(a, b); }
+static inline F fmadd(F a, F b, F c) { return _mm256_fmadd_ps(a, b, c); }
+static inline F fnmadd(F a, F b, F c) { return _mm256_fnmadd_ps(a, b, c); }
+static inline F vmax(F a, F b) { return _mm256_max_ps(a, b); }
+static inline F vmin(F a, F b) { return _mm256_min_ps(a, b); }
+static inline F vfloor(F a) { return _mm256_floor_ps(a); }
+static inline I toInt(F a) { return _mm256_cvtps_epi32(a); }
+static inline F toFloat(I a) { return _mm256_cvtepi32_ps(a); }
+static inline I asInt(F a) { return _mm256_castps_si256(a); }
+static inline F asFloat(I a) { return _mm256_castsi256_ps(a); }
+static inline I iadd(I a, I b) { return _mm256_add_epi32(a, b); }
+static inline I isub(I a, I b) { return _mm256_sub_epi32(a, b); }
+static inline I iand(I a, I b) { return _mm256_and_si256(a, b); }
+static inline I ior(I a, I b) { return _mm256_or_si256(a, b); }
+static inline I imax(I a, I b) { return _mm256_max_epi32(a, b); }
+static inline I shl23(I a) { return _mm256_slli_epi32(a, 23); }
+static inline I shr23(I a) { return _mm256_srli_epi32(a, 23); }
+static inline M cmplt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+static inline M cmpge(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+static inline M cmpnan(F a) { return _mm256_cmp_ps(a, a, _CMP_UNORD_Q); }
+static inline F select(M m, F a, F b) { return _mm256_blendv_ps(b, a, m); }
+static inline uint32_t bits(M m) { return _mm256_movemask_ps(m); }
+static inline float hsum(F v) {
+  __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+  s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+  return _mm_cvtss_f32(_mm_add_ss(s, _mm_movehdup_ps(s)));
+}
+static inline float hmax(F v) {
+  __m128 s = _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+  s = _mm_max_ps(s, _mm_movehl_ps(s, s));
+  return _mm_cvtss_f32(_mm_max_ss(s, _mm_movehdup_ps(s)));
+}
+
+#include "kernels_impl.h"
+
+}  // namespace avx2
+
+const KernelOps& avx2Ops() { return avx2::kOps; }
+
+#else
+
+const KernelOps& avx2Ops() { return sse42Ops(); }
+
+#endif
+
+}  // namespace kernels
+
+}  // namespace fasttext
@@ -0,0 +1,89 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+// AVX-512 kernels, compiled with -mavx512f -mavx2 -mfma.
+
+#include "kernels.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+// The AVX-512 intrinsics of GCC start from _mm512_undefined_ps() and friends,
+// which it then reports as uninitialized.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+namespace fasttext {
+
+namespace kernels {
+
+#if defined(__AVX512F__)
+
+namespace avx512 {
+
+typedef __m512 F;
+typedef __m512i I;
+typedef __mmask16 M;
+constexpr int32_t LANES = 16;
+
+static inline F load(const float* x) { return _mm512_loadu_ps(x); }
+static inline void store(float* x, F v) { _mm512_storeu_ps(x, v); }
+static inline F set1(float v) { return _mm512_set1_ps(v); }
+static inline I set1i(int32_t v) { return _mm512_set1_epi32(v); }
+static inline F add(F a, F b) { return _mm512_add_ps(a, b); }
+static inline F sub(F a, F b) { return _mm512_sub_ps(a, b); }
+static inline F mul(F a, F b) { return _mm512_mul_ps(a, b); }
+static inline F div(F a, F b) { return _mm512_div_ps(a, b); }
+static inline F fmadd(F a, F b, F c) { return _mm512_fmadd_ps(a, b, c); }
+static inline F fnmadd(F a, F b, F c) { return _mm512_fnmadd_ps(a, b, c); }
+static inline F vmax(F a, F b) { return _mm512_max_ps(a, b); }
+static inline F vmin(F a, F b) { return _mm512_min_ps(a, b); }
+static inline F vfloor(F a) {
+  return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+}
+static inline I toInt(F a) { return _mm512_cvtps_epi32(a); }
+static inline F toFloat(I a) { return _mm512_cvtepi32_ps(a); }
+static inline I asInt(F a) { return _mm512_castps_si512(a); }
+static inline F asFloat(I a) { return _mm512_castsi512_ps(a); }
+static inline I iadd(I a, I b) { return _mm512_add_epi32(a, b); }
+static inline I isub(I a, I b) { return _mm512_sub_epi32(a, b); }
+static inline I iand(I a, I b) { return _mm512_and_si512(a, b); }
+static inline I ior(I a, I b) { return _mm512_or_si512(a, b); }
+static inline I imax(I a, I b) { return _mm512_max_epi32(a, b); }
+static inline I shl23(I a) { return _mm512_slli_epi32(a, 23); }
+static inline I shr23(I a) { return _mm512_srli_epi32(a, 23); }
+static inline M cmplt(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+static inline M cmpge(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_GE_OQ); }
+static inline M cmpnan(F a) { return _mm512_cmp_ps_mask(a, a, _CMP_UNORD_Q); }
+static inline F select(M m, F a, F b) { return _mm512_mask_blend_ps(m, b, a); }
+static inline uint32_t bits(M m) { return m; }
+static inline float hsum(F v) { return _mm512_reduce_add_ps(v); }
+static inline float hmax(F v) { return _mm512_reduce_max_ps(v); }
+
+#include "kernels_impl.h"
+
+}  // namespace avx512
+
+const KernelOps& avx512Ops() { return avx512::kOps; }
+
+#else
+
+const KernelOps& avx512Ops() { return avx2Ops(); }
+
+#endif
+
+}  // namespace kernels
+
+}  // namespace fasttext
@@ -0,0 +1,397 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+// Kernel bodies shared by every instruction set. This file is included once
+// per kernels_<isa>.cc, inside the namespace of that instruction set and
+// after it has defined its vector type F of LANES floats, with the integer
+// type I and the comparison mask M, and the operations on them used below.
+// Plain loops are left to the compiler, which vectorizes them for the flags
+// of the including file.
+
+// Same order as Model::comparePairs: the heap front is the smallest value.
+static inline bool greater(const std::pair<float, int32_t>& l,
+                           const std::pair<float, int32_t>& r) {
+  return l.first > r.first;
+}
+
+static inline void push(std::vector<std::pair<float, int32_t>>& heap,
+                        int32_t k, float v, int32_t i) {
+  if (heap.size() == k && v <= heap.front().first) {
+    return;
+  }
+  heap.push_back(std::make_pair(v, i));
+  std::push_heap(heap.begin(), heap.end(), greater);
+  if (heap.size() > k) {
+    std::pop_heap(heap.begin(), heap.end(), greater);
+    heap.pop_back();
+  }
+}
+
+// Two accumulators hide the latency of the multiply-add.
+static float dot(const float* x, const float* y, int64_t n) {
+  F a0 = set1(0.0f), a1 = set1(0.0f);
+  int64_t i = 0;
+  for (; i + 2 * LANES <= n; i += 2 * LANES) {
+    a0 = fmadd(load(x + i), load(y + i), a0);
+    a1 = fmadd(load(x + i + LANES), load(y + i + LANES), a1);
+  }
+  for (; i + LANES <= n; i += LANES) {
+    a0 = fmadd(load(x + i), load(y + i), a0);
+  }
+  float r = hsum(add(a0, a1));
+  for (; i < n; i++) {
+    r += x[i] * y[i];
+  }
+  return r;
+}
+
+static void axpy(float a, const float* x, float* y, int64_t n) {
+  const F va = set1(a);
+  int64_t i = 0;
+  for (; i + LANES <= n; i += LANES) {
+    store(y + i, fmadd(va, load(x + i), load(y + i)));
+  }
+  for (; i < n; i++) {
+    y[i] += a * x[i];
+  }
+}
+
+static void axpy2(float a, const float* x, float* y, float* z, int64_t n) {
+  const F va = set1(a);
+  int64_t i = 0;
+  for (; i + LANES <= n; i += LANES) {
+    const F vy = load(y + i);
+    store(z + i, fmadd(va, vy, load(z + i)));
+    store(y + i, fmadd(va, load(x + i), vy));
+  }
+  for (; i < n; i++) {
+    z[i] += a * y[i];
+    y[i] += a * x[i];
+  }
+}
+
+static void scale(float a, float* x, int64_t n) {
+  const F va = set1(a);
+  int64_t i = 0;
+  for (; i + LANES <= n; i += LANES) {
+    store(x + i, mul(va, load(x + i)));
+  }
+  for (; i < n; i++) {
+    x[i] *= a;
+  }
+}
+
+static float distL2(const float* x, const float* y, int64_t n) {
+  F a0 = set1(0.0f), a1 = set1(0.0f);
+  int64_t i = 0;
+  for (; i + 2 * LANES <= n; i += 2 * LANES) {
+    const F t0 = sub(load(x + i), load(y + i));
+    const F t1 = sub(load(x + i + LANES), load(y + i + LANES));
+    a0 = fmadd(t0, t0, a0);
+    a1 = fmadd(t1, t1, a1);
+  }
+  for (; i + LANES <= n; i += LANES) {
+    const F t = sub(load(x + i), load(y + i));
+    a0 = fmadd(t, t, a0);
+  }
+  float r = hsum(add(a0, a1));
+  for (; i < n; i++) {
+    const float t = x[i] - y[i];
+    r += t * t;
+  }
+  return r;
+}
+
+static inline void prefetchRow(const float* row, int64_t n) {
+  for (int64_t i = 0; i < n; i += 64 / sizeof(float)) {
+    __builtin_prefetch(row + i);
+  }
+  __builtin_prefetch(row + n - 1);
+}
+
+// Rows are fetched SUM_ROWS_AHEAD ids before they are added, and added two
+// at a time so that out is loaded and stored once per pair.
+static void sumRows(const float* base, int64_t stride, const int32_t* ids,
+                    int64_t count, const float* weights, int64_t n,
+                    float* out) {
+  for (int64_t k = 0; k < std::min(count, SUM_ROWS_AHEAD); k++) {
+    prefetchRow(base + ids[k] * stride, n);
+  }
+  int64_t k = 0;
+  for (; k + 2 <= count; k += 2) {
+    const int64_t ahead = std::min(count, k + 2 + SUM_ROWS_AHEAD);
+    for (int64_t j = k + SUM_ROWS_AHEAD; j < ahead; j++) {
+      prefetchRow(base + ids[j] * stride, n);
+    }
+    const float* r0 = base + ids[k] * stride;
+    const float* r1 = base + ids[k + 1] * stride;
+    const float a0 = weights ? weights[k] : 1.0;
+    const float a1 = weights ? weights[k + 1] : 1.0;
+    const F w0 = set1(a0);
+    const F w1 = set1(a1);
+    int64_t i = 0;
+    for (; i + LANES <= n; i += LANES) {
+      const F o = fmadd(w0, load(r0 + i), load(out + i));
+      store(out + i, fmadd(w1, load(r1 + i), o));
+    }
+    for (; i < n; i++) {
+      out[i] = (out[i] + a0 * r0[i]) + a1 * r1[i];
+    }
+  }
+  if (k < count) {
+    const float* r0 = base + ids[k] * stride;
+    const float a0 = weights ? weights[k] : 1.0;
+    const F w0 = set1(a0);
+    int64_t i = 0;
+    for (; i + LANES <= n; i += LANES) {
+      store(out + i, fmadd(w0, load(r0 + i), load(out + i)));
+    }
+    for (; i < n; i++) {
+      out[i] += a0 * r0[i];
+    }
+  }
+}
+
+// The innermost loop is a contiguous multiply-add over TILE_COLS columns,
+// and the TILE_ROWS rows of a share each load of packed.
+static void tile(const float* const* a, const float* packed, int64_t d,
+                 int64_t stride, float* out) {
+  float acc[TILE_ROWS][TILE_COLS] = {};
+  const float* p = packed;
+  for (int64_t j = 0; j < d; j++, p += stride) {
+    for (int32_t i = 0; i < TILE_ROWS; i++) {
+      const float x = a[i][j];
+      for (int32_t r = 0; r < TILE_COLS; r++) {
+        acc[i][r] += x * p[r];
+      }
+    }
+  }
+  for (int32_t i = 0; i < TILE_ROWS; i++) {
+    std::copy(acc[i], acc[i] + TILE_COLS, out + i * TILE_COLS);
+  }
+}
+
+// Scores n 8-bit codes of nsubq bytes against a table of ksub entries per
+// subquantizer. Rows are processed in blocks so that the accumulators stay
+// in registers and the lookups of one subquantizer can be issued together
+// (gathers on AVX2).
+static void pqScan8(const float* table, const uint8_t* codes, int32_t n,
+                    int32_t nsubq, int32_t ksub, float* out) {
+  constexpr int32_t block = 16;
+  for (int32_t i0 = 0; i0 < n; i0 += block) {
+    const int32_t nb = std::min(block, n - i0);
+    const uint8_t* code = codes + int64_t(i0) * nsubq;
+    float acc[block] = {0};
+    for (int32_t m = 0; m < nsubq; m++) {
+      const float* tm = table + m * ksub;
+      for (int32_t j = 0; j < nb; j++) {
+        acc[j] += tm[code[j * nsubq + m]];
+      }
+    }
+    std::copy(acc, acc + nb, out + i0);
+  }
+}
+
+// Scores n 4-bit codes packed in blocks of 16 rows (see ProductQuantizer)
+// against byte tables of 16 entries per subquantizer: out = inv * sum +
+// bias. A block is looked up with one byte shuffle per nibble and summed in
+// 16-bit lanes, flushed to 32 bits before they can overflow.
+static void pqScan4(const uint8_t* lut, const uint8_t* codes, int32_t n,
+                    int32_t npairs, float inv, float bias, float* out) {
+  constexpr int32_t flush = 128;
+  for (int32_t b = 0; b * 16 < n; b++) {
+    const uint8_t* block = codes + int64_t(b) * npairs * 16;
+    uint32_t acc[16] = {0};
+    for (int32_t p0 = 0; p0 < npairs; p0 += flush) {
+      const int32_t p1 = std::min(npairs, p0 + flush);
+#if defined(__SSSE3__)
+      const __m128i mask = _mm_set1_epi8(0x0f);
+      const __m128i zero = _mm_setzero_si128();
+      __m128i acclo = _mm_setzero_si128();
+      __m128i acchi = _mm_setzero_si128();
+      for (int32_t p = p0; p < p1; p++) {
+        const __m128i c =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + p * 16));
+        const __m128i lut0 =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(lut + 2 * p * 16));
+        const __m128i lut1 = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(lut + (2 * p + 1) * 16));
+        const __m128i v0 = _mm_shuffle_epi8(lut0, _mm_and_si128(c, mask));
+        const __m128i v1 =
+            _mm_shuffle_epi8(lut1, _mm_and_si128(_mm_srli_epi16(c, 4), mask));
+        acclo = _mm_add_epi16(acclo, _mm_unpacklo_epi8(v0, zero));
+        acchi = _mm_add_epi16(acchi, _mm_unpackhi_epi8(v0, zero));
+        acclo = _mm_add_epi16(acclo, _mm_unpacklo_epi8(v1, zero));
+        acchi = _mm_add_epi16(acchi, _mm_unpackhi_epi8(v1, zero));
+      }
+      uint16_t partial[16];
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(partial), acclo);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(partial + 8), acchi);
+      for (int32_t r = 0; r < 16; r++) {
+        acc[r] += partial[r];
+      }
+#else
+      for (int32_t p = p0; p < p1; p++) {
+        const uint8_t* lut0 = lut + 2 * p * 16;
+        const uint8_t* lut1 = lut0 + 16;
+        for (int32_t r = 0; r < 16; r++) {
+          const uint8_t c = block[p * 16 + r];
+          acc[r] += lut0[c & 0x0f] + lut1[c >> 4];
+        }
+      }
+#endif
+    }
+    const int32_t nb = std::min(16, n - b * 16);
+    for (int32_t r = 0; r < nb; r++) {
+      out[b * 16 + r] = acc[r] * inv + bias;
+    }
+  }
+}
+
+// Cephes-style exp: 2^n * p(r) with r = x - n log(2) and a degree 6
+// polynomial, relative error below 2e-7 on [-87, 88]. Inputs below -87
+// give 0 and NaN gives NaN, which the clamp alone would turn into a number.
+static inline F vexp(F x) {
+  const M nan = cmpnan(x);
+  x = vmax(vmin(x, set1(88.3762626647949f)), set1(-88.3762626647949f));
+  const F n = vfloor(fmadd(x, set1(1.44269504088896341f), set1(0.5f)));
+  F r = fnmadd(n, set1(0.693359375f), x);
+  r = fnmadd(n, set1(-2.12194440e-4f), r);
+  F p = set1(1.9875691500E-4f);
+  p = fmadd(p, r, set1(1.3981999507E-3f));
+  p = fmadd(p, r, set1(8.3334519073E-3f));
+  p = fmadd(p, r, set1(4.1665795894E-2f));
+  p = fmadd(p, r, set1(1.6666665459E-1f));
+  p = fmadd(p, r, set1(5.0000001201E-1f));
+  p = fmadd(p, mul(r, r), r);
+  p = add(p, set1(1.0f));
+  const I e = imax(iadd(toInt(n), set1i(127)), set1i(0));
+  return select(nan, set1(std::numeric_limits<float>::quiet_NaN()),
+                mul(p, asFloat(shl23(e))));
+}
+
+// Cephes-style log: the mantissa, in [sqrt(2) / 2, sqrt(2)), goes through a
+// degree 9 polynomial and the exponent is added back, relative error below
+// 3e-7 for positive normal inputs; NaN gives NaN.
+static inline F vlog(F x) {
+  const F one = set1(1.0f);
+  const M nan = cmpnan(x);
+  x = vmax(x, set1(std::numeric_limits<float>::min()));
+  const I bits = asInt(x);
+  F e = toFloat(isub(shr23(bits), set1i(126)));
+  F m = asFloat(ior(iand(bits, set1i(0x007fffff)), set1i(0x3f000000)));
+  const M small = cmplt(m, set1(0.707106781186547524f));
+  e = select(small, sub(e, one), e);
+  m = select(small, sub(add(m, m), one), sub(m, one));
+  const F z = mul(m, m);
+  F y = set1(7.0376836292E-2f);
+  y = fmadd(y, m, set1(-1.1514610310E-1f));
+  y = fmadd(y, m, set1(1.1676998740E-1f));
+  y = fmadd(y, m, set1(-1.2420140846E-1f));
+  y = fmadd(y, m, set1(1.4249322787E-1f));
+  y = fmadd(y, m, set1(-1.6668057665E-1f));
+  y = fmadd(y, m, set1(2.0000714765E-1f));
+  y = fmadd(y, m, set1(-2.4999993993E-1f));
+  y = fmadd(y, m, set1(3.3333331174E-1f));
+  y = mul(mul(y, m), z);
+  y = fmadd(e, set1(-2.12194440e-4f), y);
+  y = fnmadd(z, set1(0.5f), y);
+  return select(nan, set1(std::numeric_limits<float>::quiet_NaN()),
+                fmadd(e, set1(0.693359375f), add(m, y)));
+}
+
+static float max(const float* x, int64_t n) {
+  F m = set1(-std::numeric_limits<float>::infinity());
+  int64_t i = 0;
+  for (; i + LANES <= n; i += LANES) {
+    m = vmax(m, load(x + i));
+  }
+  float r = hmax(m);
+  for (; i < n; i++) {
+    r = std::max(r, x[i]);
+  }
+  return r;
+}
+
+static float sumExp(const float* x, int64_t n, float shift) {
+  const F s = set1(shift);
+  F acc = set1(0.0f);
+  int64_t i = 0;
+  for (; i + LANES <= n; i += LANES) {
+    acc = add(acc, vexp(sub(load(x + i), s)));
+  }
+  float r = hsum(acc);
+  for (; i < n; i++) {
+    r += std::exp(x[i] - shift);
+  }
+  return r;
+}
+
+static void expShift(float* x, int64_t n, float shift) {
+  const F s = set1(shift);
+  int64_t i = 0;
+  for (; i + LANES <= n; i += LANES) {
+    store(x + i, vexp(sub(load(x + i), s)));
+  }
+  for (; i < n; i++) {
+    x[i] = std::exp(x[i] - shift);
+  }
+}
+
+static void sigmoid(float* x, int64_t n) {
+  const F one = set1(1.0f);
+  int64_t i = 0;
+  for (; i + LANES <= n; i += LANES) {
+    const F e = vexp(sub(set1(0.0f), load(x + i)));
+    store(x + i, div(one, add(one, e)));
+  }
+  for (; i < n; i++) {
+    x[i] = 1.0 / (1.0 + std::exp(-x[i]));
+  }
+}
+
+static void log(float* x, int64_t n) {
+  int64_t i = 0;
+  for (; i + LANES <= n; i += LANES) {
+    store(x + i, vlog(load(x + i)));
+  }
+  for (; i < n; i++) {
+    x[i] = std::log(x[i]);
+  }
+}
+
+// Lanes below bound are rejected LANES at a time; bound rises to the
+// smallest kept value once the heap is full.
+static void topK(const float* x, int64_t n, int32_t k, float cutoff,
+                 std::vector<std::pair<float, int32_t>>& heap) {
+  float bound =
+      heap.size() == k ? std::max(cutoff, heap.front().first) : cutoff;
+  int64_t i = 0;
+  for (; i + LANES <= n; i += LANES) {
+    uint32_t mask = bits(cmpge(load(x + i), set1(bound)));
+    while (mask) {
+      const int32_t j = __builtin_ctz(mask);
+      mask &= mask - 1;
+      push(heap, k, x[i + j], i + j);
+      if (heap.size() == k) {
+        bound = std::max(cutoff, heap.front().first);
+      }
+    }
+  }
+  for (; i < n; i++) {
+    if (x[i] >= cutoff) {
+      push(heap, k, x[i], i);
+    }
+  }
+}
+
+static const KernelOps kOps = {dot,     axpy,    scale,    axpy2,
+                               distL2,  sumRows, tile,     pqScan8,
+                               pqScan4, max,     sumExp,   expShift,
+                               sigmoid, log,     topK};
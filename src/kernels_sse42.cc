@@ -0,0 +1,88 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+// SSE4.2 kernels, compiled with -msse4.2.
+
+#include "kernels.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE4_2__)
+#include <immintrin.h>
+#endif
+
+namespace fasttext {
+
+namespace kernels {
+
+#if defined(__SSE4_2__)
+
+namespace sse42 {
+
+typedef __m128 F;
+typedef __m128i I;
+typedef __m128 M;
+constexpr int32_t LANES = 4;
+
+static inline F load(const float* x) { return _mm_loadu_ps(x); }
+static inline void store(float* x, F v) { _mm_storeu_ps(x, v); }
+static inline F set1(float v) { return _mm_set1_ps(v); }
+static inline I set1i(int32_t v) { return _mm_set1_epi32(v); }
+static inline F add(F a, F b) { return _mm_add_ps(a, b); }
+static inline F sub(F a, F b) { return _mm_sub_ps(a, b); }
+static inline F mul(F a, F b) { return _mm_mul_ps(a, b); }
+static inline F div(F a, F b) { return _mm_div_ps(a, b); }
+static inline F fmadd(F a, F b, F c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+static inline F fnmadd(F a, F b, F c) {
+  return _mm_sub_ps(c, _mm_mul_ps(a, b));
+}
+static inline F vmax(F a, F b) { return _mm_max_ps(a, b); }
+static inline F vmin(F a, F b) { return _mm_min_ps(a, b); }
+static inline F vfloor(F a) { return _mm_floor_ps(a); }
+static inline I toInt(F a) { return _mm_cvtps_epi32(a); }
+static inline F toFloat(I a) { return _mm_cvtepi32_ps(a); }
+static inline I asInt(F a) { return _mm_castps_si128(a); }
+static inline F asFloat(I a) { return _mm_castsi128_ps(a); }
+static inline I iadd(I a, I b) { return _mm_add_epi32(a, b); }
+static inline I isub(I a, I b) { return _mm_sub_epi32(a, b); }
+static inline I iand(I a, I b) { return _mm_and_si128(a, b); }
+static inline I ior(I a, I b) { return _mm_or_si128(a, b); }
+static inline I imax(I a, I b) { return _mm_max_epi32(a, b); }
+static inline I shl23(I a) { return _mm_slli_epi32(a, 23); }
+static inline I shr23(I a) { return _mm_srli_epi32(a, 23); }
+static inline M cmplt(F a, F b) { return _mm_cmplt_ps(a, b); }
+static inline M cmpge(F a, F b) { return _mm_cmpge_ps(a, b); }
+static inline M cmpnan(F a) { return _mm_cmpunord_ps(a, a); }
+static inline F select(M m, F a, F b) { return _mm_blendv_ps(b, a, m); }
+static inline uint32_t bits(M m) { return _mm_movemask_ps(m); }
+static inline float hsum(F v) {
+  v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+  return _mm_cvtss_f32(_mm_add_ss(v, _mm_movehdup_ps(v)));
+}
+static inline float hmax(F v) {
+  v = _mm_max_ps(v, _mm_movehl_ps(v, v));
+  return _mm_cvtss_f32(_mm_max_ss(v, _mm_movehdup_ps(v)));
+}
+
+#include "kernels_impl.h"
+
+}  // namespace sse42
+
+const KernelOps& sse42Ops() { return sse42::kOps; }
+
+#else
+
+const KernelOps& sse42Ops() { return scalarOps(); }
+
+#endif
+
+}  // namespace kernels
+
+}  // namespace fasttext
@@ -0,0 +1,186 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "knn.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+
+#include "affinity.h"
+#include "kernels.h"
+
+namespace fasttext {
+
+// Rows per packed block: a block of 300-dimensional rows stays in L2.
+constexpr int32_t KNN_ROW_BLOCK = 128;
+// Queries and rows scored together by the register-blocked kernel.
+constexpr int32_t KNN_QUERY_TILE = kernels::TILE_ROWS;
+constexpr int32_t KNN_ROW_TILE = kernels::TILE_COLS;
+
+// Higher score first, lower id first among equal scores.
+static inline bool better(const std::pair<float, int32_t>& a,
+                          const std::pair<float, int32_t>& b) {
+  return a.first > b.first || (a.first == b.first && a.second < b.second);
+}
+
+// Scores KNN_QUERY_TILE queries against a packed block, column-major with
+// KNN_ROW_BLOCK rows per dimension.
+static void scoreTile(const float* const* q, const float* packed, int64_t d,
+                      int32_t nrows, float* scores) {
+  float acc[KNN_QUERY_TILE * KNN_ROW_TILE];
+  for (int32_t r0 = 0; r0 < nrows; r0 += KNN_ROW_TILE) {
+    kernels::tile(q, packed + r0, d, KNN_ROW_BLOCK, acc);
+    for (int32_t i = 0; i < KNN_QUERY_TILE; i++) {
+      std::copy(acc + i * KNN_ROW_TILE, acc + (i + 1) * KNN_ROW_TILE,
+                scores + i * KNN_ROW_BLOCK + r0);
+    }
+  }
+}
+
+static inline void push(std::vector<std::pair<float, int32_t>>& heap,
+                        int32_t k, float score, int32_t id,
+                        const std::vector<int32_t>& ban) {
+  if (heap.size() == k && score <= heap.front().first) {
+    return;
+  }
+  if (!ban.empty() && std::find(ban.begin(), ban.end(), id) != ban.end()) {
+    return;
+  }
+  if (heap.size() == k) {
+    std::pop_heap(heap.begin(), heap.end(), better);
+    heap.back() = std::make_pair(score, id);
+  } else {
+    heap.push_back(std::make_pair(score, id));
+  }
+  std::push_heap(heap.begin(), heap.end(), better);
+}
+
+ExactKNN::ExactKNN(int32_t nthreads) : nthreads_(std::max(nthreads, 1)) {}
+
+// Rows are visited in increasing order within a range, so that a row only
+// replaces the heap top on a strictly higher score and ties keep the lower
+// id.
+void ExactKNN::searchRange(const Matrix& vectors, const Matrix& queries,
+                           int32_t k,
+                           const std::vector<std::vector<int32_t>>& bans,
+                           int64_t begin, int64_t end,
+                           std::vector<Heap>& heaps) const {
+  const int64_t d = vectors.cols();
+  const int64_t nq = queries.rows();
+  static const std::vector<int32_t> noBan;
+  heaps.assign(nq, Heap());
+  for (auto& heap : heaps) {
+    heap.reserve(k);
+  }
+  if (nq < KNN_QUERY_TILE) {
+    for (int64_t i = begin; i < end; i++) {
+      for (int64_t q = 0; q < nq; q++) {
+        const float s = kernels::dot(queries.row(q), vectors.row(i), d);
+        push(heaps[q], k, s, i, bans.empty() ? noBan : bans[q]);
+      }
+    }
+    return;
+  }
+  std::vector<float> packed(d * KNN_ROW_BLOCK, 0.0);
+  std::vector<float> scores(KNN_QUERY_TILE * KNN_ROW_BLOCK);
+  for (int64_t b = begin; b < end; b += KNN_ROW_BLOCK) {
+    const int32_t nrows = std::min<int64_t>(KNN_ROW_BLOCK, end - b);
+    for (int32_t r = 0; r < nrows; r++) {
+      const float* x = vectors.row(b + r);
+      for (int64_t j = 0; j < d; j++) {
+        packed[j * KNN_ROW_BLOCK + r] = x[j];
+      }
+    }
+    for (int32_t r = nrows; r < KNN_ROW_BLOCK; r++) {
+      for (int64_t j = 0; j < d; j++) {
+        packed[j * KNN_ROW_BLOCK + r] = 0.0;
+      }
+    }
+    for (int64_t q0 = 0; q0 < nq; q0 += KNN_QUERY_TILE) {
+      const float* q[KNN_QUERY_TILE];
+      for (int32_t i = 0; i < KNN_QUERY_TILE; i++) {
+        q[i] = queries.row(std::min<int64_t>(q0 + i, nq - 1));
+      }
+      scoreTile(q, packed.data(), d, nrows, scores.data());
+      for (int32_t i = 0; i < KNN_QUERY_TILE && q0 + i < nq; i++) {
+        const float* s = scores.data() + i * KNN_ROW_BLOCK;
+        const std::vector<int32_t>& ban = bans.empty() ? noBan : bans[q0 + i];
+        for (int32_t r = 0; r < nrows; r++) {
+          push(heaps[q0 + i], k, s[r], b + r, ban);
+        }
+      }
+    }
+  }
+}
+
+void ExactKNN::search(
+    const Matrix& vectors, const Matrix& queries, int32_t k,
+    const std::vector<std::vector<int32_t>>& bans,
+    std::vector<std::vector<std::pair<float, int32_t>>>& results) const {
+  if (queries.cols() != vectors.cols()) {
+    throw std::invalid_argument("Queries and vectors differ in dimension!");
+  }
+  if (!bans.empty() && bans.size() != queries.rows()) {
+    throw std::invalid_argument("Need one ban list per query!");
+  }
+  const int64_t n = vectors.rows();
+  const int64_t nq = queries.rows();
+  results.assign(nq, std::vector<std::pair<float, int32_t>>());
+  if (k <= 0 || n == 0) {
+    return;
+  }
+  // Ranges are whole row blocks and no smaller than a few of them.
+  const int64_t nblocks = (n + KNN_ROW_BLOCK - 1) / KNN_ROW_BLOCK;
+  const int32_t nthreads =
+      std::max<int64_t>(1, std::min<int64_t>(nthreads_, nblocks / 4));
+  std::vector<std::vector<Heap>> heaps(nthreads);
+  std::vector<std::thread> threads;
+  for (int32_t t = 0; t < nthreads; t++) {
+    const int64_t begin = std::min(n, nblocks * t / nthreads * KNN_ROW_BLOCK);
+    const int64_t end =
+        std::min(n, nblocks * (t + 1) / nthreads * KNN_ROW_BLOCK);
+    if (nthreads == 1) {
+      affinity::ScopedPin pin("knn", 0);
+      searchRange(vectors, queries, k, bans, begin, end, heaps[t]);
+    } else {
+      threads.push_back(std::thread([&, t, begin, end]() {
+        affinity::pin("knn", t);
+        searchRange(vectors, queries, k, bans, begin, end, heaps[t]);
+      }));
+    }
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  for (int64_t q = 0; q < nq; q++) {
+    auto& merged = results[q];
+    for (int32_t t = 0; t < nthreads; t++) {
+      merged.insert(merged.end(), heaps[t][q].begin(), heaps[t][q].end());
+    }
+    const int64_t kq = std::min<int64_t>(k, merged.size());
+    std::partial_sort(merged.begin(), merged.begin() + kq, merged.end(),
+                      better);
+    merged.resize(kq);
+  }
+}
+
+void ExactKNN::search(const Matrix& vectors, const Vector& query, int32_t k,
+                      const std::vector<int32_t>& ban,
+                      std::vector<std::pair<float, int32_t>>& results) const {
+  Matrix queries(1, query.size());
+  std::copy(query.data(), query.data() + query.size(), queries.row(0));
+  std::vector<std::vector<int32_t>> bans(1, ban);
+  std::vector<std::vector<std::pair<float, int32_t>>> all;
+  search(vectors, queries, k, bans, all);
+  results = std::move(all[0]);
+}
+
+}  // namespace fasttext
@@ -0,0 +1,47 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "matrix.h"
+#include "vector.h"
+
+namespace fasttext {
+
+// Exact k nearest neighbours by inner product over the rows of a matrix.
+// The rows are split between threads; each thread scores tiles of queries
+// against packed blocks of rows and keeps a bounded heap per query, and the
+// heaps of all threads are merged at the end. Banned ids never enter a heap,
+// so every query gets k results whenever enough rows are left.
+class ExactKNN {
+ protected:
+  typedef std::vector<std::pair<float, int32_t>> Heap;
+
+  int32_t nthreads_;
+
+  void searchRange(const Matrix&, const Matrix&, int32_t,
+                   const std::vector<std::vector<int32_t>>&, int64_t, int64_t,
+                   std::vector<Heap>&) const;
+
+ public:
+  explicit ExactKNN(int32_t nthreads = 1);
+
+  void search(const Matrix&, const Matrix&, int32_t,
+              const std::vector<std::vector<int32_t>>&,
+              std::vector<std::vector<std::pair<float, int32_t>>>&) const;
+  void search(const Matrix&, const Vector&, int32_t,
+              const std::vector<int32_t>&,
+              std::vector<std::pair<float, int32_t>>&) const;
+};
+
+}  // namespace fasttext
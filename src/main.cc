@@ -7,9 +7,12 @@
  * of patent rights can be found in the PATENTS file in the same directory.
  */
 
+#include <algorithm>
+#include <cmath>
 #include <iomanip>
 #include <iostream>
 #include <queue>
+#include <thread>
 #include "args.h"
 #include "fasttext.h"
 
@@ -23,6 +26,8 @@ void printUsage() {
       << "  quantize                quantize a model to reduce the memory "
          "usage\n"
       << "  test                    evaluate a supervised classifier\n"
+      << "  test-label              print labels with precision and recall "
+         "scores\n"
       << "  predict                 predict most likely labels\n"
       << "  predict-prob            predict most likely labels with "
          "probabilities\n"
@@ -34,6 +39,12 @@ void printUsage() {
       << "  print-ngrams            print ngrams given a trained model and "
          "word\n"
       << "  nn                      query for nearest neighbors\n"
+      << "  nn-index                build a nearest neighbor index for nn and "
+         "analogies\n"
+      << "  nn-ivf                  build a compressed nearest neighbor index "
+         "for nn and analogies\n"
+      << "  nn-vectors              save normalized word vectors for nn and "
+         "analogies\n"
       << "  analogies               query for analogies\n"
       << "  dump                    dump arguments,dictionary,input/output "
          "vectors\n"
@@ -46,24 +57,54 @@ void printQuantizeUsage() {
 
 void printTestUsage() {
   std::cerr
-      << "usage: fasttext test <model> <test-data> [<k>] [<th>]\n\n"
+      << "usage: fasttext test <model> <test-data> [<k>] [<th>] "
+         "[-thread <n>]\n\n"
       << "  <model>      model filename\n"
       << "  <test-data>  test data filename (if -, read from stdin)\n"
       << "  <k>          (optional; 1 by default) predict top k labels\n"
       << "  <th>         (optional; 0.0 by default) probability threshold\n"
+      << "  -thread      (optional; 1 by default) number of threads\n"
+      << std::endl;
+}
+
+void printTestLabelUsage() {
+  std::cerr
+      << "usage: fasttext test-label <model> <test-data> [<k>] [<th>] "
+         "[-thread <n>]\n\n"
+      << "  <model>      model filename\n"
+      << "  <test-data>  test data filename (if -, read from stdin)\n"
+      << "  <k>          (optional; 1 by default) predict top k labels\n"
+      << "  <th>         (optional; 0.0 by default) probability threshold\n"
+      << "  -thread      (optional; 1 by default) number of threads\n"
       << std::endl;
 }
 
 void printPredictUsage() {
   std::cerr
-      << "usage: fasttext predict[-prob] <model> <test-data> [<k>] [<th>]\n\n"
+      << "usage: fasttext predict[-prob] <model> <test-data> [<k>] [<th>] "
+         "[-thread <n>]\n\n"
       << "  <model>      model filename\n"
       << "  <test-data>  test data filename (if -, read from stdin)\n"
       << "  <k>          (optional; 1 by default) predict top k labels\n"
       << "  <th>         (optional; 0.0 by default) probability threshold\n"
+      << "  -thread      (optional; 1 by default) number of threads, input "
+         "is then read in chunks\n"
       << std::endl;
 }
 
+// Removes "-thread <n>" from args and returns n, or 1 if it is absent.
+int32_t parseThreadOption(std::vector<std::string>& args) {
+  int32_t nthreads = 1;
+  for (auto it = args.begin(); it != args.end(); ++it) {
+    if (*it == "-thread" && it + 1 != args.end()) {
+      nthreads = std::stoi(*(it + 1));
+      args.erase(it, it + 2);
+      break;
+    }
+  }
+  return nthreads;
+}
+
 void printPrintWordVectorsUsage() {
   std::cerr << "usage: fasttext print-word-vectors <model>\n\n"
             << "  <model>      model filename\n"
@@ -100,28 +141,104 @@ void quantize(const std::vector<std::string>& args) {
 }
 
 void printNNUsage() {
-  std::cout << "usage: fasttext nn <model> <k>\n\n"
+  std::cout << "usage: fasttext nn <model> <k> <ef>\n\n"
             << "  <model>      model filename\n"
             << "  <k>          (optional; 10 by default) predict top k labels\n"
+            << "  <ef>         (optional; 64 by default) search breadth of the "
+               "index, if <model>.hnsw or <model>.ivf exists\n"
+            << std::endl;
+}
+
+void printNNIndexUsage() {
+  std::cout << "usage: fasttext nn-index <model> <M> <efConstruction>\n\n"
+            << "  <model>           model filename, the index is saved to "
+               "<model>.hnsw\n"
+            << "  <M>               (optional; 16 by default) links per word\n"
+            << "  <efConstruction>  (optional; 200 by default) search breadth "
+               "while building\n"
+            << std::endl;
+}
+
+void printNNVectorsUsage() {
+  std::cout << "usage: fasttext nn-vectors <model> <format>\n\n"
+            << "  <model>      model filename, the vectors are saved to "
+               "<model>.nnv\n"
+            << "  <format>     (optional; fp32 by default) fp32, fp16 or int8\n"
+            << std::endl;
+}
+
+void printNNIVFUsage() {
+  std::cout << "usage: fasttext nn-ivf <model> <nlist> <dsub> <nbits>\n\n"
+            << "  <model>      model filename, the index is saved to "
+               "<model>.ivf\n"
+            << "  <nlist>      (optional; 4 sqrt(words) by default) number of "
+               "lists\n"
+            << "  <dsub>       (optional; 2 by default) size of each "
+               "sub-vector\n"
+            << "  <nbits>      (optional; 8 by default) bits per sub-vector "
+               "code, 4 or 8\n"
             << std::endl;
 }
 
 void printAnalogiesUsage() {
-  std::cout << "usage: fasttext analogies <model> <k>\n\n"
+  std::cout << "usage: fasttext analogies <model> <k> <ef>\n\n"
             << "  <model>      model filename\n"
             << "  <k>          (optional; 10 by default) predict top k labels\n"
+            << "  <ef>         (optional; 64 by default) search breadth of the "
+               "index, if <model>.hnsw or <model>.ivf exists\n"
             << std::endl;
 }
 
+void loadNNIndex(FastText& fasttext, const std::string& modelPath,
+                 int32_t ef) {
+  std::string indexPath = modelPath + ".hnsw";
+  std::string ivfPath = modelPath + ".ivf";
+  if (std::ifstream(indexPath).good()) {
+    std::cerr << "Using nearest neighbor index " << indexPath << std::endl;
+    fasttext.loadNNIndex(indexPath);
+  } else if (std::ifstream(ivfPath).good()) {
+    std::cerr << "Using nearest neighbor index " << ivfPath << std::endl;
+    fasttext.loadIVFIndex(ivfPath);
+  }
+  fasttext.setNNSearchEf(ef);
+}
+
+// The IVF index keeps its own codes and needs no word vectors.
+std::shared_ptr<const Matrix> getNNVectors(FastText& fasttext,
+                                           const std::string& modelPath) {
+  if (fasttext.hasIVFIndex()) {
+    return std::make_shared<Matrix>();
+  }
+  std::string vectorsPath = modelPath + ".nnv";
+  if (std::ifstream(vectorsPath).good()) {
+    std::cerr << "Using word vectors " << vectorsPath << std::endl;
+    return fasttext.loadNNVectors(vectorsPath);
+  }
+  std::shared_ptr<const Dictionary> dict = fasttext.getDictionary();
+  auto wordVectors =
+      std::make_shared<Matrix>(dict->nwords(), fasttext.getDimension());
+  std::cerr << "Pre-computing word vectors...";
+  fasttext.precomputeWordVectors(*wordVectors);
+  std::cerr << " done." << std::endl;
+  return wordVectors;
+}
+
 void printDumpUsage() {
   std::cout << "usage: fasttext dump <model> <option>\n\n"
             << "  <model>      model filename\n"
             << "  <option>     option from args,dict,input,output" << std::endl;
 }
 
-void test(const std::vector<std::string>& args) {
+void test(const std::vector<std::string>& argv) {
+  std::vector<std::string> args(argv);
+  const int32_t nthreads = parseThreadOption(args);
+  const bool perLabel = args[1] == "test-label";
   if (args.size() < 4 || args.size() > 6) {
-    printTestUsage();
+    if (perLabel) {
+      printTestLabelUsage();
+    } else {
+      printTestUsage();
+    }
     exit(EXIT_FAILURE);
   }
   int32_t k = 1;
@@ -136,28 +253,46 @@ void test(const std::vector<std::string>& args) {
   FastText fasttext;
   fasttext.loadModel(args[2]);
 
-  std::tuple<int64_t, double, double> result;
+  Meter meter;
   std::string infile = args[3];
   if (infile == "-") {
-    result = fasttext.test(std::cin, k, threshold);
+    fasttext.test(std::cin, k, threshold, meter, nthreads);
   } else {
     std::ifstream ifs(infile);
     if (!ifs.is_open()) {
       std::cerr << "Test file cannot be opened!" << std::endl;
       exit(EXIT_FAILURE);
     }
-    result = fasttext.test(ifs, k, threshold);
+    fasttext.test(ifs, k, threshold, meter, nthreads);
     ifs.close();
   }
-  std::cout << "N"
-            << "\t" << std::get<0>(result) << std::endl;
-  std::cout << std::setprecision(3);
-  std::cout << "P@" << k << "\t" << std::get<1>(result) << std::endl;
-  std::cout << "R@" << k << "\t" << std::get<2>(result) << std::endl;
-  std::cerr << "Number of examples: " << std::get<0>(result) << std::endl;
+  if (perLabel) {
+    std::shared_ptr<const Dictionary> dict = fasttext.getDictionary();
+    std::cout << std::fixed << std::setprecision(6);
+    auto writeMetric = [](const std::string& name, double value) {
+      std::cout << name << " : ";
+      if (std::isfinite(value)) {
+        std::cout << value;
+      } else {
+        std::cout << "--------";
+      }
+      std::cout << "  ";
+    };
+    for (int32_t i = 0; i < dict->nlabels(); i++) {
+      writeMetric("F1-Score", meter.f1Score(i));
+      writeMetric("Precision", meter.precision(i));
+      writeMetric("Recall", meter.recall(i));
+      std::cout << " " << dict->getLabel(i) << std::endl;
+    }
+    std::cout.unsetf(std::ios_base::floatfield);
+  }
+  meter.writeGeneralMetrics(std::cout, k);
+  std::cerr << "Number of examples: " << meter.nexamples() << std::endl;
 }
 
-void predict(const std::vector<std::string>& args) {
+void predict(const std::vector<std::string>& argv) {
+  std::vector<std::string> args(argv);
+  const int32_t nthreads = parseThreadOption(args);
   if (args.size() < 4 || args.size() > 6) {
     printPredictUsage();
     exit(EXIT_FAILURE);
@@ -177,14 +312,14 @@ void predict(const std::vector<std::string>& args) {
 
   std::string infile(args[3]);
   if (infile == "-") {
-    fasttext.predict(std::cin, k, print_prob, threshold);
+    fasttext.predict(std::cin, k, print_prob, threshold, nthreads);
   } else {
     std::ifstream ifs(infile);
     if (!ifs.is_open()) {
       std::cerr << "Input file cannot be opened!" << std::endl;
       exit(EXIT_FAILURE);
     }
-    fasttext.predict(ifs, k, print_prob, threshold);
+    fasttext.predict(ifs, k, print_prob, threshold, nthreads);
     ifs.close();
   }
 
@@ -235,24 +370,25 @@ void printNgrams(const std::vector<std::string> args) {
 }
 
 void nn(const std::vector<std::string> args) {
-  int32_t k;
-  if (args.size() == 3) {
-    k = 10;
-  } else if (args.size() == 4) {
-    k = std::stoi(args[3]);
-  } else {
+  int32_t k = 10;
+  int32_t ef = 64;
+  if (args.size() < 3 || args.size() > 5) {
     printNNUsage();
     exit(EXIT_FAILURE);
   }
+  if (args.size() > 3) {
+    k = std::stoi(args[3]);
+  }
+  if (args.size() > 4) {
+    ef = std::stoi(args[4]);
+  }
   FastText fasttext;
   fasttext.loadModel(std::string(args[2]));
+  fasttext.setNNThreads(std::max(1u, std::thread::hardware_concurrency()));
+  loadNNIndex(fasttext, args[2], ef);
   std::string queryWord;
-  std::shared_ptr<const Dictionary> dict = fasttext.getDictionary();
   Vector queryVec(fasttext.getDimension());
-  Matrix wordVectors(dict->nwords(), fasttext.getDimension());
-  std::cerr << "Pre-computing word vectors...";
-  fasttext.precomputeWordVectors(wordVectors);
-  std::cerr << " done." << std::endl;
+  std::shared_ptr<const Matrix> wordVectors = getNNVectors(fasttext, args[2]);
   std::set<std::string> banSet;
   std::cout << "Query word? ";
   std::vector<std::pair<float, std::string>> results;
@@ -260,7 +396,7 @@ void nn(const std::vector<std::string> args) {
     banSet.clear();
     banSet.insert(queryWord);
     fasttext.getWordVector(queryVec, queryWord);
-    fasttext.findNN(wordVectors, queryVec, k, banSet, results);
+    fasttext.findNN(*wordVectors, queryVec, k, banSet, results);
     for (auto& pair : results) {
       std::cout << pair.second << " " << pair.first << std::endl;
     }
@@ -269,19 +405,110 @@ void nn(const std::vector<std::string> args) {
   exit(0);
 }
 
+void nnIndex(const std::vector<std::string> args) {
+  int32_t M = 16;
+  int32_t efConstruction = 200;
+  if (args.size() < 3 || args.size() > 5) {
+    printNNIndexUsage();
+    exit(EXIT_FAILURE);
+  }
+  if (args.size() > 3) {
+    M = std::stoi(args[3]);
+  }
+  if (args.size() > 4) {
+    efConstruction = std::stoi(args[4]);
+  }
+  FastText fasttext;
+  fasttext.loadModel(std::string(args[2]));
+  std::shared_ptr<const Matrix> wordVectors = getNNVectors(fasttext, args[2]);
+  int32_t nthreads = std::max(1u, std::thread::hardware_concurrency());
+  fasttext.setNNThreads(nthreads);
+  std::cerr << "Building index...";
+  fasttext.buildNNIndex(*wordVectors, M, efConstruction, nthreads);
+  std::cerr << " done." << std::endl;
+  fasttext.saveNNIndex(args[2] + ".hnsw");
+  for (int32_t ef : {16, 64, 256}) {
+    fasttext.setNNSearchEf(ef);
+    std::cout << "ef " << ef << "\tR@10 " << std::setprecision(3)
+              << fasttext.testNNIndex(*wordVectors, 10, 1000) << std::endl;
+  }
+  exit(0);
+}
+
+void nnIVF(const std::vector<std::string> args) {
+  if (args.size() < 3 || args.size() > 6) {
+    printNNIVFUsage();
+    exit(EXIT_FAILURE);
+  }
+  FastText fasttext;
+  fasttext.loadModel(std::string(args[2]));
+  int32_t nwords = fasttext.getDictionary()->nwords();
+  int32_t nlist = std::max(1, int32_t(4 * std::sqrt(nwords)));
+  int32_t dsub = 2;
+  int32_t nbits = 8;
+  if (args.size() > 3) {
+    nlist = std::stoi(args[3]);
+  }
+  if (args.size() > 4) {
+    dsub = std::stoi(args[4]);
+  }
+  if (args.size() > 5) {
+    nbits = std::stoi(args[5]);
+  }
+  int32_t nthreads = std::max(1u, std::thread::hardware_concurrency());
+  fasttext.setNNThreads(nthreads);
+  std::cerr << "Building index...";
+  fasttext.buildIVFIndex(nlist, dsub, nbits, nthreads);
+  std::cerr << " done." << std::endl;
+  fasttext.saveIVFIndex(args[2] + ".ivf");
+  for (int32_t nprobe : {4, 16, 64}) {
+    fasttext.setNNSearchEf(nprobe);
+    std::cout << "nprobe " << nprobe << "\tR@10 " << std::setprecision(3)
+              << fasttext.testIVFIndex(10, 1000) << std::endl;
+  }
+  exit(0);
+}
+
 void analogies(const std::vector<std::string> args) {
-  int32_t k;
-  if (args.size() == 3) {
-    k = 10;
-  } else if (args.size() == 4) {
-    k = std::stoi(args[3]);
-  } else {
+  int32_t k = 10;
+  int32_t ef = 64;
+  if (args.size() < 3 || args.size() > 5) {
     printAnalogiesUsage();
     exit(EXIT_FAILURE);
   }
+  if (args.size() > 3) {
+    k = std::stoi(args[3]);
+  }
+  if (args.size() > 4) {
+    ef = std::stoi(args[4]);
+  }
+  FastText fasttext;
+  fasttext.loadModel(std::string(args[2]));
+  fasttext.setNNThreads(std::max(1u, std::thread::hardware_concurrency()));
+  loadNNIndex(fasttext, args[2], ef);
+  fasttext.analogies(k, *getNNVectors(fasttext, args[2]));
+  exit(0);
+}
+
+void nnVectors(const std::vector<std::string> args) {
+  if (args.size() < 3 || args.size() > 4) {
+    printNNVectorsUsage();
+    exit(EXIT_FAILURE);
+  }
+  vector_format format = vector_format::fp32;
+  if (args.size() > 3) {
+    if (args[3] == "fp16") {
+      format = vector_format::fp16;
+    } else if (args[3] == "int8") {
+      format = vector_format::int8;
+    } else if (args[3] != "fp32") {
+      printNNVectorsUsage();
+      exit(EXIT_FAILURE);
+    }
+  }
   FastText fasttext;
   fasttext.loadModel(std::string(args[2]));
-  fasttext.analogies(k);
+  fasttext.saveNNVectors(args[2] + ".nnv", format);
   exit(0);
 }
 
@@ -344,7 +571,7 @@ int main(int argc, char** argv) {
   std::string command(args[1]);
   if (command == "skipgram" || command == "cbow" || command == "supervised") {
     train(args);
-  } else if (command == "test") {
+  } else if (command == "test" || command == "test-label") {
     test(args);
   } else if (command == "quantize") {
     quantize(args);
@@ -356,6 +583,12 @@ int main(int argc, char** argv) {
     printNgrams(args);
   } else if (command == "nn") {
     nn(args);
+  } else if (command == "nn-index") {
+    nnIndex(args);
+  } else if (command == "nn-ivf") {
+    nnIVF(args);
+  } else if (command == "nn-vectors") {
+    nnVectors(args);
   } else if (command == "analogies") {
     analogies(args);
   } else if (command == "predict" || command == "predict-prob") {
@@ -0,0 +1,269 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "mappedmatrix.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#include "hugepages.h"
+
+namespace fasttext {
+
+constexpr int32_t MAPPED_MATRIX_MAGIC_INT32 = 1314283078;
+constexpr int32_t MAPPED_MATRIX_VERSION = 1;
+constexpr int64_t MAPPED_MATRIX_ALIGN = 64;
+
+namespace {
+
+struct Header {
+  int32_t magic;
+  int32_t version;
+  int32_t format;
+  int32_t reserved;
+  int64_t rows;
+  int64_t cols;
+  // Elements per row in the file, padding included.
+  int64_t stride;
+  int64_t padding[3];
+};
+
+static_assert(sizeof(Header) == MAPPED_MATRIX_ALIGN, "Header is one line");
+
+int64_t align(int64_t bytes) {
+  return (bytes + MAPPED_MATRIX_ALIGN - 1) / MAPPED_MATRIX_ALIGN *
+      MAPPED_MATRIX_ALIGN;
+}
+
+int64_t elementSize(vector_format format) {
+  switch (format) {
+    case vector_format::fp32:
+      return sizeof(float);
+    case vector_format::fp16:
+      return sizeof(uint16_t);
+    case vector_format::int8:
+      return sizeof(int8_t);
+  }
+  throw std::invalid_argument("Unknown vector format!");
+}
+
+// IEEE half precision with round to nearest even.
+uint16_t toHalf(float f) {
+  uint32_t x;
+  std::memcpy(&x, &f, sizeof(x));
+  const uint32_t sign = (x >> 16) & 0x8000;
+  const int32_t biased = (x >> 23) & 0xff;
+  uint32_t mant = x & 0x7fffff;
+  if (biased == 0xff) {
+    return sign | 0x7c00 | (mant ? 0x200 : 0);
+  }
+  const int32_t exp = biased - 127 + 15;
+  if (exp >= 31) {
+    return sign | 0x7c00;
+  }
+  int32_t shift = 13;
+  uint32_t h;
+  if (exp <= 0) {
+    if (exp < -10) {
+      return sign;
+    }
+    mant |= 0x800000;
+    shift = 14 - exp;
+    h = mant >> shift;
+  } else {
+    h = (uint32_t(exp) << 10) | (mant >> shift);
+  }
+  const uint32_t rem = mant & ((1u << shift) - 1);
+  const uint32_t half = 1u << (shift - 1);
+  if (rem > half || (rem == half && (h & 1))) {
+    h++;
+  }
+  return sign | h;
+}
+
+float fromHalf(uint16_t h) {
+  const uint32_t sign = uint32_t(h & 0x8000) << 16;
+  int32_t exp = (h >> 10) & 0x1f;
+  uint32_t mant = h & 0x3ff;
+  uint32_t x;
+  if (exp == 0) {
+    if (mant == 0) {
+      x = sign;
+    } else {
+      exp = 127 - 15 + 1;
+      while (!(mant & 0x400)) {
+        mant <<= 1;
+        exp--;
+      }
+      x = sign | (uint32_t(exp) << 23) | ((mant & 0x3ff) << 13);
+    }
+  } else if (exp == 31) {
+    x = sign | 0x7f800000 | (mant << 13);
+  } else {
+    x = sign | (uint32_t(exp + 127 - 15) << 23) | (mant << 13);
+  }
+  float f;
+  std::memcpy(&f, &x, sizeof(f));
+  return f;
+}
+
+}  // namespace
+
+MappedMatrix::MappedMatrix(void* map, std::size_t mapSize, std::size_t m,
+                           std::size_t n, std::size_t stride)
+    : Matrix(
+          reinterpret_cast<float*>(static_cast<char*>(map) + sizeof(Header)),
+          m,
+          n,
+          stride),
+      map_(map),
+      mapSize_(mapSize) {}
+
+MappedMatrix::~MappedMatrix() { munmap(map_, mapSize_); }
+
+void MappedMatrix::save(const std::string& filename, const Matrix& mat,
+                        vector_format format) {
+  std::ofstream ofs(filename, std::ofstream::binary);
+  if (!ofs.is_open()) {
+    throw std::invalid_argument(filename + " cannot be opened for saving!");
+  }
+  const int64_t m = mat.rows();
+  const int64_t n = mat.cols();
+  const int64_t esize = elementSize(format);
+  Header header = {};
+  header.magic = MAPPED_MATRIX_MAGIC_INT32;
+  header.version = MAPPED_MATRIX_VERSION;
+  header.format = static_cast<int32_t>(format);
+  header.rows = m;
+  header.cols = n;
+  header.stride = align(n * esize) / esize;
+  ofs.write((char*)&header, sizeof(Header));
+
+  std::vector<float> scales;
+  if (format == vector_format::int8) {
+    scales.assign(align(m * sizeof(float)) / sizeof(float), 0.0);
+    for (int64_t i = 0; i < m; i++) {
+      const float* x = mat.row(i);
+      float amax = 0.0;
+      for (int64_t j = 0; j < n; j++) {
+        amax = std::max(amax, std::abs(x[j]));
+      }
+      scales[i] = amax / 127;
+    }
+    ofs.write((char*)scales.data(), scales.size() * sizeof(float));
+  }
+  std::vector<char> buffer(header.stride * esize, 0);
+  for (int64_t i = 0; i < m; i++) {
+    const float* x = mat.row(i);
+    if (format == vector_format::fp32) {
+      std::memcpy(buffer.data(), x, n * sizeof(float));
+    } else if (format == vector_format::fp16) {
+      uint16_t* h = reinterpret_cast<uint16_t*>(buffer.data());
+      for (int64_t j = 0; j < n; j++) {
+        h[j] = toHalf(x[j]);
+      }
+    } else {
+      int8_t* c = reinterpret_cast<int8_t*>(buffer.data());
+      const float inv = scales[i] > 0 ? 1.0 / scales[i] : 0.0;
+      for (int64_t j = 0; j < n; j++) {
+        c[j] = std::max(-127.0f, std::min(127.0f, std::round(x[j] * inv)));
+      }
+    }
+    ofs.write(buffer.data(), buffer.size());
+  }
+  if (!ofs) {
+    throw std::runtime_error("Failed to write " + filename);
+  }
+  ofs.close();
+}
+
+std::shared_ptr<const Matrix> MappedMatrix::load(const std::string& filename) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::invalid_argument(filename + " cannot be opened for loading!");
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < int64_t(sizeof(Header))) {
+    close(fd);
+    throw std::invalid_argument(filename + " is not a word vector matrix!");
+  }
+  const std::size_t size = st.st_size;
+  void* map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    throw std::runtime_error(filename + " cannot be mapped!");
+  }
+  Header header;
+  std::memcpy(&header, map, sizeof(Header));
+  int64_t expected = -1;
+  if (header.magic == MAPPED_MATRIX_MAGIC_INT32 &&
+      header.version <= MAPPED_MATRIX_VERSION && header.format >= 0 &&
+      header.format <= static_cast<int32_t>(vector_format::int8) &&
+      header.rows >= 0 && header.cols >= 0 && header.stride >= header.cols) {
+    const vector_format format = static_cast<vector_format>(header.format);
+    expected = sizeof(Header) +
+        header.rows * header.stride * elementSize(format) +
+        (format == vector_format::int8 ? align(header.rows * sizeof(float))
+                                       : 0);
+  }
+  if (expected != int64_t(size)) {
+    munmap(map, size);
+    throw std::invalid_argument(filename + " is not a word vector matrix!");
+  }
+  const char* data = static_cast<const char*>(map) + sizeof(Header);
+  const vector_format format = static_cast<vector_format>(header.format);
+  // File pages are not backed by huge pages, so with FASTTEXT_HUGEPAGES set
+  // fp32 rows are copied into memory like the other formats.
+  const bool copy = hugepages::activeMode() != hugepages::mode::off;
+  if (format == vector_format::fp32 && !copy) {
+    madvise(map, size, MADV_WILLNEED);
+    return std::shared_ptr<const Matrix>(
+        new MappedMatrix(map, size, header.rows, header.cols, header.stride));
+  }
+  auto mat = std::make_shared<Matrix>(header.rows, header.cols);
+  if (format == vector_format::fp32) {
+    for (int64_t i = 0; i < header.rows; i++) {
+      const float* x = reinterpret_cast<const float*>(data) + i * header.stride;
+      std::copy(x, x + header.cols, mat->row(i));
+    }
+  } else if (format == vector_format::fp16) {
+    for (int64_t i = 0; i < header.rows; i++) {
+      const uint16_t* h =
+          reinterpret_cast<const uint16_t*>(data) + i * header.stride;
+      float* x = mat->row(i);
+      for (int64_t j = 0; j < header.cols; j++) {
+        x[j] = fromHalf(h[j]);
+      }
+    }
+  } else {
+    const float* scales = reinterpret_cast<const float*>(data);
+    const int8_t* codes = reinterpret_cast<const int8_t*>(
+        data + align(header.rows * sizeof(float)));
+    for (int64_t i = 0; i < header.rows; i++) {
+      const int8_t* c = codes + i * header.stride;
+      float* x = mat->row(i);
+      for (int64_t j = 0; j < header.cols; j++) {
+        x[j] = scales[i] * c[j];
+      }
+    }
+  }
+  munmap(map, size);
+  return mat;
+}
+
+}  // namespace fasttext
@@ -0,0 +1,43 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "matrix.h"
+
+namespace fasttext {
+
+enum class vector_format : int32_t { fp32 = 0, fp16 = 1, int8 = 2 };
+
+// A matrix saved with rows aligned to 64 bytes after a 64-byte header, so
+// that fp32 files are used in place through a read-only memory map. Rows
+// saved as fp16, or as int8 with one scale per row, are decoded into memory
+// when loaded.
+class MappedMatrix : public Matrix {
+ protected:
+  void* map_;
+  std::size_t mapSize_;
+
+  MappedMatrix(void*, std::size_t, std::size_t, std::size_t, std::size_t);
+
+ public:
+  MappedMatrix(const MappedMatrix&) = delete;
+  MappedMatrix& operator=(const MappedMatrix&) = delete;
+  ~MappedMatrix();
+
+  static void save(const std::string&, const Matrix&, vector_format);
+  static std::shared_ptr<const Matrix> load(const std::string&);
+};
+
+}  // namespace fasttext
@@ -10,28 +10,36 @@
 #include "matrix.h"
 #include <iostream>
 
+#include <algorithm>
 #include <cmath>
 #include <exception>
 #include <random>
 #include <stdexcept>
 
-#include <ipp.h>
-
+#include "backend.h"
+#include "kernels.h"
 #include "utils.h"
 #include "vector.h"
 
 namespace fasttext {
-Matrix::~Matrix() { ippsFree(data_); }
+Matrix::~Matrix() {
+  if (owner_) {
+    backend::release(data_);
+  }
+}
 
 Matrix::Matrix() : Matrix(0, 0) {}
 
-Matrix::Matrix(std::size_t m, std::size_t n) : m_(m), n_(n) {
+Matrix::Matrix(std::size_t m, std::size_t n) : m_(m), n_(n), owner_(true) {
   stride_ = std::ceil(static_cast<float>(n_ * sizeof(float)) / 64) * 64 /
             sizeof(float);
-  data_ = ippsMalloc_32f_L(m_ * stride_);
+  data_ = backend::allocate(m_ * stride_);
 }
 
-void Matrix::zero() { ippsZero_32f(data_, m_ * stride_); }
+Matrix::Matrix(float* data, std::size_t m, std::size_t n, std::size_t stride)
+    : data_(data), m_(m), n_(n), stride_(stride), owner_(false) {}
+
+void Matrix::zero() { backend::zero(data_, m_ * stride_); }
 
 void Matrix::uniform(float a) {
   std::minstd_rand rng(1);
@@ -44,22 +52,71 @@ void Matrix::uniform(float a) {
 float Matrix::dotRow(const Vector& vec, std::size_t i) const {
   assert(i < m_);
   assert(vec.size() == n_);
-  float d;
-  ippsDotProd_32f(data_ + i * stride_, vec.data(), n_, &d);
-  if (std::isnan(d)) {
-    throw std::runtime_error("Encountered NaN.");
-  }
-  return d;
+  return backend::dot(data_ + i * stride_, vec.data(), n_);
 }
 
 void Matrix::addRow(const Vector& vec, std::size_t i) {
-  ippsAdd_32f_I(vec.data(), data_ + i * stride_, n_);
+  backend::add(vec.data(), data_ + i * stride_, n_);
 }
 
 void Matrix::addRow(const Vector& vec, std::size_t i, float a) {
   assert(i < m_);
   assert(vec.size() == n_);
-  ippsAddProductC_32f(vec.data(), a, data_ + i * stride_, n_);
+  backend::axpy(a, vec.data(), data_ + i * stride_, n_);
+}
+
+// grad += a * row i, then row i += a * vec, reading the row once.
+void Matrix::updateRow(const Vector& vec, std::size_t i, float a,
+                       Vector& grad) {
+  assert(i < m_);
+  assert(vec.size() == n_ && grad.size() == n_);
+  backend::axpy2(a, vec.data(), data_ + i * stride_, grad.data(), n_);
+}
+
+// out += the rows ids[0..n), each times weights[k] unless weights is null.
+void Matrix::sumRows(const int32_t* ids, int64_t n, const float* weights,
+                     float* out) const {
+  kernels::sumRows(data_, stride_, ids, n, weights, n_, out);
+}
+
+// Rows of B packed per block and rows of A and B scored per tile by mul().
+constexpr int32_t GEMM_BLOCK = 128;
+constexpr int32_t GEMM_TILE_A = kernels::TILE_ROWS;
+constexpr int32_t GEMM_TILE_B = kernels::TILE_COLS;
+
+// Sets this to A B^T: entry (i, j) is the dot product of row i of A and row
+// j of B. Blocks of B are packed column-major so that the innermost loop of
+// the kernel is a contiguous multiply-add over GEMM_TILE_B rows, while
+// GEMM_TILE_A rows of A share each load.
+void Matrix::mul(const Matrix& A, const Matrix& B) {
+  assert(A.n_ == B.n_);
+  assert(m_ == A.m_ && n_ == B.m_);
+  const int64_t d = A.n_;
+  std::vector<float> packed(d * GEMM_BLOCK, 0.0);
+  for (int64_t b0 = 0; b0 < B.m_; b0 += GEMM_BLOCK) {
+    const int32_t nb = std::min<int64_t>(GEMM_BLOCK, B.m_ - b0);
+    for (int32_t r = 0; r < GEMM_BLOCK; r++) {
+      const float* x = r < nb ? B.row(b0 + r) : nullptr;
+      for (int64_t j = 0; j < d; j++) {
+        packed[j * GEMM_BLOCK + r] = x ? x[j] : 0.0;
+      }
+    }
+    for (int64_t a0 = 0; a0 < A.m_; a0 += GEMM_TILE_A) {
+      const float* a[GEMM_TILE_A];
+      for (int32_t i = 0; i < GEMM_TILE_A; i++) {
+        a[i] = A.row(std::min<int64_t>(a0 + i, A.m_ - 1));
+      }
+      for (int32_t r0 = 0; r0 < nb; r0 += GEMM_TILE_B) {
+        float acc[GEMM_TILE_A * GEMM_TILE_B];
+        kernels::tile(a, packed.data() + r0, d, GEMM_BLOCK, acc);
+        const int32_t nr = std::min(GEMM_TILE_B, nb - r0);
+        for (int32_t i = 0; i < GEMM_TILE_A && a0 + i < A.m_; i++) {
+          std::copy(acc + i * GEMM_TILE_B, acc + i * GEMM_TILE_B + nr,
+                    row(a0 + i) + b0 + r0);
+        }
+      }
+    }
+  }
 }
 
 // void Matrix::multiplyRow(const Vector& nums, std::size_t ib, int64_t ie) {
@@ -93,8 +150,7 @@ void Matrix::divideRow(const Vector& denoms, std::size_t ib, int64_t ie) {
 }
 
 float Matrix::l2NormRow(std::size_t i) const {
-  float norm;
-  ippsNorm_L2_32f(data_, n_, &norm);
+  const float norm = backend::norm(data_ + i * stride_, n_);
 
   if (std::isnan(norm)) {
     throw std::runtime_error("Encountered NaN.");
@@ -120,7 +176,7 @@ void Matrix::load(std::istream& in) {
   in.read((char*)&n_, sizeof(n_));
   stride_ = std::ceil(static_cast<float>(n_ * sizeof(float)) / 64) * 64 /
             sizeof(float);
-  data_ = ippsMalloc_32f_L(m_ * stride_);
+  data_ = backend::allocate(m_ * stride_);
   in.read((char*)data_, m_ * stride_ * sizeof(*data_));
 }
 
@@ -26,6 +26,10 @@ class Matrix {
   const std::size_t m_;
   const std::size_t n_;
   std::size_t stride_;
+  bool owner_;
+
+  // Wraps rows that live elsewhere, stride floats apart; they are not freed.
+  Matrix(float*, std::size_t, std::size_t, std::size_t);
 
  public:
   Matrix();
@@ -57,6 +61,9 @@ class Matrix {
   float dotRow(const Vector&, std::size_t) const;
   void addRow(const Vector&, std::size_t, float);
   void addRow(const Vector& vec, std::size_t i);
+  void updateRow(const Vector&, std::size_t, float, Vector&);
+  void sumRows(const int32_t*, int64_t, const float*, float*) const;
+  void mul(const Matrix&, const Matrix&);
 
   void multiplyRow(const Vector& nums, std::size_t ib = 0, int64_t ie = -1);
   void divideRow(const Vector& denoms, std::size_t ib = 0, int64_t ie = -1);
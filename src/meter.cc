@@ -0,0 +1,105 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "meter.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <limits>
+
+namespace fasttext {
+
+double Meter::Metrics::precision() const {
+  if (predicted == 0) {
+    return std::numeric_limits<double>::quiet_NaN();
+  }
+  return predictedGold / double(predicted);
+}
+
+double Meter::Metrics::recall() const {
+  if (gold == 0) {
+    return std::numeric_limits<double>::quiet_NaN();
+  }
+  return predictedGold / double(gold);
+}
+
+double Meter::Metrics::f1Score() const {
+  if (predicted + gold == 0) {
+    return std::numeric_limits<double>::quiet_NaN();
+  }
+  return 2 * predictedGold / double(predicted + gold);
+}
+
+Meter::Meter() : nexamples_(0) {}
+
+void Meter::log(const std::vector<int32_t>& labels,
+                const std::vector<std::pair<float, int32_t>>& predictions) {
+  nexamples_++;
+  metrics_.gold += labels.size();
+  metrics_.predicted += predictions.size();
+
+  for (const auto& prediction : predictions) {
+    labelMetrics_[prediction.second].predicted++;
+    if (std::find(labels.begin(), labels.end(), prediction.second) !=
+        labels.end()) {
+      labelMetrics_[prediction.second].predictedGold++;
+      metrics_.predictedGold++;
+    }
+  }
+
+  for (const auto& label : labels) {
+    labelMetrics_[label].gold++;
+  }
+}
+
+void Meter::add(const Meter& other) {
+  nexamples_ += other.nexamples_;
+  metrics_.gold += other.metrics_.gold;
+  metrics_.predicted += other.metrics_.predicted;
+  metrics_.predictedGold += other.metrics_.predictedGold;
+  for (const auto& it : other.labelMetrics_) {
+    Metrics& m = labelMetrics_[it.first];
+    m.gold += it.second.gold;
+    m.predicted += it.second.predicted;
+    m.predictedGold += it.second.predictedGold;
+  }
+}
+
+double Meter::precision(int32_t i) const {
+  auto it = labelMetrics_.find(i);
+  return it == labelMetrics_.end() ? Metrics().precision()
+                                   : it->second.precision();
+}
+
+double Meter::recall(int32_t i) const {
+  auto it = labelMetrics_.find(i);
+  return it == labelMetrics_.end() ? Metrics().recall() : it->second.recall();
+}
+
+double Meter::f1Score(int32_t i) const {
+  auto it = labelMetrics_.find(i);
+  return it == labelMetrics_.end() ? Metrics().f1Score()
+                                   : it->second.f1Score();
+}
+
+double Meter::precision() const { return metrics_.precision(); }
+
+double Meter::recall() const { return metrics_.recall(); }
+
+uint64_t Meter::nexamples() const { return nexamples_; }
+
+void Meter::writeGeneralMetrics(std::ostream& out, int32_t k) const {
+  out << "N"
+      << "\t" << nexamples_ << std::endl;
+  out << std::setprecision(3);
+  out << "P@" << k << "\t" << metrics_.precision() << std::endl;
+  out << "R@" << k << "\t" << metrics_.recall() << std::endl;
+}
+
+}  // namespace fasttext
@@ -0,0 +1,57 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace fasttext {
+
+// Precision and recall of predicted labels, overall and per label. Meters
+// filled by different threads are combined with add().
+class Meter {
+ protected:
+  struct Metrics {
+    uint64_t gold;
+    uint64_t predicted;
+    uint64_t predictedGold;
+
+    Metrics() : gold(0), predicted(0), predictedGold(0) {}
+
+    double precision() const;
+    double recall() const;
+    double f1Score() const;
+  };
+
+  Metrics metrics_;
+  uint64_t nexamples_;
+  std::unordered_map<int32_t, Metrics> labelMetrics_;
+
+ public:
+  Meter();
+
+  void log(const std::vector<int32_t>&,
+           const std::vector<std::pair<float, int32_t>>&);
+  void add(const Meter&);
+
+  double precision(int32_t) const;
+  double recall(int32_t) const;
+  double f1Score(int32_t) const;
+  double precision() const;
+  double recall() const;
+  uint64_t nexamples() const;
+
+  void writeGeneralMetrics(std::ostream&, int32_t) const;
+};
+
+}  // namespace fasttext
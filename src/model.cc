@@ -11,14 +11,14 @@
 
 #include <assert.h>
 #include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <limits>
 #include <stdexcept>
 
-namespace fasttext {
+#include "kernels.h"
 
-constexpr int64_t SIGMOID_TABLE_SIZE = 512;
-constexpr int64_t MAX_SIGMOID = 8;
-constexpr int64_t LOG_TABLE_SIZE = 512;
+namespace fasttext {
 
 Model::Model(std::shared_ptr<Matrix> wi, std::shared_ptr<Matrix> wo,
              std::shared_ptr<Args> args, int32_t seed)
@@ -35,10 +35,6 @@ Model::Model(std::shared_ptr<Matrix> wi, std::shared_ptr<Matrix> wo,
   negpos = 0;
   loss_ = 0.0;
   nexamples_ = 1;
-  t_sigmoid_.reserve(SIGMOID_TABLE_SIZE + 1);
-  t_log_.reserve(LOG_TABLE_SIZE + 1);
-  initSigmoid();
-  initLog();
 }
 
 void Model::setQuantizePointer(std::shared_ptr<QMatrix> qwi,
@@ -50,92 +46,213 @@ void Model::setQuantizePointer(std::shared_ptr<QMatrix> qwi,
   }
 }
 
-float Model::binaryLogistic(int32_t target, bool label, float lr,
+// Logistic loss over all targets at once: the scores of hidden_ against
+// every target are computed first, so that the sigmoids and the logs of the
+// loss are evaluated as blocks, then grad_ and each row are updated in a
+// single pass over the row, which is still in L1 from the dot product.
+float Model::binaryLogistic(const std::vector<int32_t>& targets,
+                            const std::vector<bool>& labels, float lr,
                             float weight) {
-  float score = sigmoid(wo_->dotRow(hidden_, target));
-  // Correct would be to use weight,  however we use log(e-1+weight) to avoid
-  // steps that are too large. For weight=1, the above expressions gives 1.
-  float alpha = lr * std::log(1.718281828459045 + weight) * (label - score);
-  grad_.addRow(*wo_, target, alpha);
-  wo_->addRow(hidden_, target, alpha);
-  if (label) {
-    return -weight * log(score);
-  } else {
-    return -weight * log(1.0 - score);
+  const int32_t n = targets.size();
+  scores_.resize(n);
+  probs_.resize(n);
+  for (int32_t i = 0; i < n; i++) {
+    scores_[i] = wo_->dotRow(hidden_, targets[i]);
+  }
+  kernels::sigmoid(scores_.data(), n);
+  for (int32_t i = 0; i < n; i++) {
+    probs_[i] = (labels[i] ? scores_[i] : 1.0 - scores_[i]) + 1e-5;
+  }
+  kernels::log(probs_.data(), n);
+  const float scale = lr * std::log(1.718281828459045 + weight);
+  float loss = 0.0;
+  for (int32_t i = 0; i < n; i++) {
+    const float alpha = scale * (labels[i] - scores_[i]);
+    wo_->updateRow(hidden_, targets[i], alpha, grad_);
+    loss -= weight * probs_[i];
   }
+  return loss;
 }
 
 float Model::negativeSampling(int32_t target, float lr, float weight) {
-  float loss = 0.0;
   grad_.zero();
-  for (int32_t n = 0; n <= args_->neg; n++) {
-    if (n == 0) {
-      loss += binaryLogistic(target, true, lr, weight);
-    } else {
-      loss += binaryLogistic(getNegative(target), false, lr, weight);
-    }
+  targets_.assign(1, target);
+  labels_.assign(1, true);
+  for (int32_t n = 0; n < args_->neg; n++) {
+    targets_.push_back(getNegative(target));
+    labels_.push_back(false);
   }
-  return loss;
+  return binaryLogistic(targets_, labels_, lr, weight);
 }
 
 float Model::hierarchicalSoftmax(int32_t target, float lr) {
-  float loss = 0.0;
   grad_.zero();
-  const std::vector<bool>& binaryCode = codes[target];
-  const std::vector<int32_t>& pathToRoot = paths[target];
-  for (int32_t i = 0; i < pathToRoot.size(); i++) {
-    loss += binaryLogistic(pathToRoot[i], binaryCode[i], lr, 1.0f);
-  }
-  return loss;
+  return binaryLogistic(paths[target], codes[target], lr, 1.0f);
 }
 
-void Model::computeOutputSoftmax(Vector& hidden, Vector& output) const {
+// Rows of the output matrix scored per step of computeOutput, and updated per
+// step of softmax: their logits are folded into the log-sum-exp, or turned
+// into gradients, while still in L1.
+constexpr int64_t SOFTMAX_BLOCK = 256;
+
+// Fewest output rows worth a thread of their own in softmax.
+constexpr int64_t SOFTMAX_THREAD_ROWS = 4096;
+
+// Sets output to the logits of hidden and returns their log-sum-exp, in one
+// pass over the output matrix.
+float Model::computeOutput(Vector& hidden, Vector& output) const {
+  kernels::LogSumExp lse;
   if (quant_ && args_->qout) {
     output.mul(*qwo_, hidden);
-  } else {
-    output.mul(*wo_, hidden);
+    lse.add(output.data(), osz_);
+    return lse.value();
   }
-  float max = output[0], z = 0.0;
-  for (int32_t i = 0; i < osz_; i++) {
-    max = std::max(output[i], max);
+  computeLogits(hidden, output, 0, osz_, lse);
+  return lse.value();
+}
+
+// Sets output[begin:end] to the logits of those output rows and folds them
+// into lse, a block at a time.
+void Model::computeLogits(const Vector& hidden, Vector& output, int64_t begin,
+                          int64_t end, kernels::LogSumExp& lse) const {
+  for (int64_t i = begin; i < end; i += SOFTMAX_BLOCK) {
+    const int64_t bend = std::min(end, i + SOFTMAX_BLOCK);
+    for (int64_t j = i; j < bend; j++) {
+      output[j] = wo_->dotRow(hidden, j);
+    }
+    lse.add(output.data() + i, bend - i);
   }
-  for (int32_t i = 0; i < osz_; i++) {
-    output[i] = exp(output[i] - max);
-    z += output[i];
+}
+
+void Model::computeOutputSoftmax(Vector& hidden, Vector& output) const {
+  kernels::expShift(output.data(), osz_, computeOutput(hidden, output));
+}
+
+void Model::computeOutputSoftmax() { computeOutputSoftmax(hidden_, output_); }
+
+// Sets every row of output to the logits of the same row of hidden, with
+// one product by the output matrix, or with one table per row when the
+// output matrix is quantized.
+void Model::computeOutput(Matrix& hidden, Matrix& output) const {
+  if (quant_ && args_->qout) {
+    Vector h(hsz_), o(osz_);
+    for (int64_t i = 0; i < hidden.rows(); i++) {
+      std::copy(hidden.row(i), hidden.row(i) + hsz_, h.data());
+      o.mul(*qwo_, h);
+      std::copy(o.data(), o.data() + osz_, output.row(i));
+    }
+  } else {
+    output.mul(hidden, *wo_);
   }
-  for (int32_t i = 0; i < osz_; i++) {
-    output[i] /= z;
+}
+
+void Model::computeOutputSoftmax(Matrix& hidden, Matrix& output) const {
+  computeOutput(hidden, output);
+  for (int64_t i = 0; i < output.rows(); i++) {
+    kernels::LogSumExp lse;
+    lse.add(output.row(i), osz_);
+    kernels::expShift(output.row(i), osz_, lse.value());
   }
 }
 
-void Model::computeOutputSoftmax() { computeOutputSoftmax(hidden_, output_); }
+// Turns the logits in output_[begin:end] into probabilities a block at a
+// time, and applies the update of each of those rows while adding its part
+// of the gradient to grad.
+void Model::softmaxUpdate(int32_t target, float lr, float lse, int64_t begin,
+                          int64_t end, Vector& grad) {
+  for (int64_t i = begin; i < end; i += SOFTMAX_BLOCK) {
+    const int64_t bend = std::min(end, i + SOFTMAX_BLOCK);
+    kernels::expShift(output_.data() + i, bend - i, lse);
+    for (int64_t j = i; j < bend; j++) {
+      const float label = (j == target) ? 1.0 : 0.0;
+      wo_->updateRow(hidden_, j, lr * (label - output_[j]), grad);
+    }
+  }
+}
 
+// Two passes over the output matrix: the logits and their log-sum-exp, then
+// the updates. With -softmaxThread, both passes are split into ranges of
+// labels, each with its own log-sum-exp and gradient, merged in between,
+// and the ranges are handed to the helper threads of softmaxWorkers_.
 float Model::softmax(int32_t target, float lr) {
   grad_.zero();
-  computeOutputSoftmax();
-  for (int32_t i = 0; i < osz_; i++) {
-    float label = (i == target) ? 1.0 : 0.0;
-    float alpha = lr * (label - output_[i]);
-    grad_.addRow(*wo_, i, alpha);
-    wo_->addRow(hidden_, i, alpha);
+  const int64_t nthreads = std::max(
+      int64_t(1), std::min(int64_t(args_->softmaxThread),
+                           int64_t(osz_) / SOFTMAX_THREAD_ROWS));
+  if (nthreads == 1) {
+    kernels::LogSumExp lse;
+    computeLogits(hidden_, output_, 0, osz_, lse);
+    const float loss = -std_log(std::exp(output_[target] - lse.value()));
+    softmaxUpdate(target, lr, lse.value(), 0, osz_, grad_);
+    return loss;
+  }
+
+  if (!softmaxWorkers_ || softmaxWorkers_->size() != nthreads) {
+    softmaxWorkers_.reset(new WorkerPool(nthreads));
+  }
+  const int64_t nblocks = (osz_ + SOFTMAX_BLOCK - 1) / SOFTMAX_BLOCK;
+  std::vector<int64_t> bounds(nthreads + 1);
+  for (int64_t t = 0; t <= nthreads; t++) {
+    bounds[t] = std::min(int64_t(osz_), nblocks * t / nthreads * SOFTMAX_BLOCK);
+  }
+  std::vector<kernels::LogSumExp> lses(nthreads);
+  softmaxWorkers_->run([&](int32_t t) {
+    computeLogits(hidden_, output_, bounds[t], bounds[t + 1], lses[t]);
+  });
+  for (int64_t t = 1; t < nthreads; t++) {
+    lses[0].merge(lses[t]);
+  }
+  const float lse = lses[0].value();
+  const float loss = -std_log(std::exp(output_[target] - lse));
+
+  while (softmaxGrads_.size() < nthreads - 1) {
+    softmaxGrads_.emplace_back(new Vector(hsz_));
+  }
+  softmaxWorkers_->run([&](int32_t t) {
+    Vector& grad = t == 0 ? grad_ : *softmaxGrads_[t - 1];
+    grad.zero();
+    softmaxUpdate(target, lr, lse, bounds[t], bounds[t + 1], grad);
+  });
+  for (int64_t t = 1; t < nthreads; t++) {
+    grad_.addVector(*softmaxGrads_[t - 1]);
+  }
+  return loss;
+}
+
+// out += the input rows of input, prefetched ahead of the sum.
+void Model::sumInputRows(const std::vector<int32_t>& input, float* out) const {
+  if (quant_) {
+    qwi_->sumRows(input.data(), input.size(), nullptr, out);
+  } else {
+    wi_->sumRows(input.data(), input.size(), nullptr, out);
   }
-  return -log(output_[target]);
 }
 
 void Model::computeHidden(const std::vector<int32_t>& input,
                           Vector& hidden) const {
   assert(hidden.size() == hsz_);
   hidden.zero();
-  if (quant_) {
-    for (auto it = input.cbegin(); it != input.cend(); ++it) {
-      hidden.addRow(*qwi_, *it);
+  sumInputRows(input, hidden.data());
+  hidden.mul(1.0 / input.size());
+}
+
+// Embedding bag: row i of hidden is the average of the input rows of
+// inputs[i], or zero if it is empty.
+void Model::computeHidden(const std::vector<std::vector<int32_t>>& inputs,
+                          Matrix& hidden) const {
+  assert(hidden.rows() == inputs.size() && hidden.cols() == hsz_);
+  for (int64_t i = 0; i < inputs.size(); i++) {
+    float* h = hidden.row(i);
+    std::fill(h, h + hsz_, 0.0);
+    if (inputs[i].empty()) {
+      continue;
     }
-  } else {
-    for (auto it = input.cbegin(); it != input.cend(); ++it) {
-      hidden.addRow(*wi_, *it);
+    sumInputRows(inputs[i], h);
+    const float scale = 1.0 / inputs[i].size();
+    for (int32_t j = 0; j < hsz_; j++) {
+      h[j] *= scale;
     }
   }
-  hidden.mul(1.0 / input.size());
 }
 
 bool Model::comparePairs(const std::pair<float, int32_t>& l,
@@ -156,7 +273,11 @@ void Model::predict(const std::vector<int32_t>& input, int32_t k,
   heap.reserve(k + 1);
   computeHidden(input, hidden);
   if (args_->loss == loss_name::hs) {
-    dfs(k, threshold, 2 * osz_ - 2, 0.0, heap, hidden);
+    std::vector<float> table;
+    if (quant_ && args_->qout) {
+      qwo_->computeTable(hidden, table);
+    }
+    dfs(k, threshold, 2 * osz_ - 2, 0.0, heap, hidden, table);
   } else {
     findKBest(k, threshold, heap, hidden, output);
   }
@@ -169,27 +290,79 @@ void Model::predict(const std::vector<int32_t>& input, int32_t k,
   predict(input, k, threshold, heap, hidden_, output_);
 }
 
+// Batched prediction: inputs[i] gets its k best labels in predictions[i],
+// which stays empty for an empty input. hidden and output must have one row
+// per input, with dim and nlabels columns.
+void Model::predict(
+    const std::vector<std::vector<int32_t>>& inputs, int32_t k,
+    float threshold,
+    std::vector<std::vector<std::pair<float, int32_t>>>& predictions,
+    Matrix& hidden, Matrix& output) const {
+  if (k <= 0) {
+    throw std::invalid_argument("k needs to be 1 or higher!");
+  }
+  if (args_->model != model_name::sup) {
+    throw std::invalid_argument("Model needs to be supervised for prediction!");
+  }
+  predictions.assign(inputs.size(), std::vector<std::pair<float, int32_t>>());
+  computeHidden(inputs, hidden);
+  if (args_->loss == loss_name::hs) {
+    Vector h(hsz_);
+    std::vector<float> table;
+    for (int64_t i = 0; i < inputs.size(); i++) {
+      if (inputs[i].empty()) {
+        continue;
+      }
+      std::copy(hidden.row(i), hidden.row(i) + hsz_, h.data());
+      if (quant_ && args_->qout) {
+        qwo_->computeTable(h, table);
+      }
+      predictions[i].reserve(k + 1);
+      dfs(k, threshold, 2 * osz_ - 2, 0.0, predictions[i], h, table);
+      std::sort_heap(predictions[i].begin(), predictions[i].end(),
+                     comparePairs);
+    }
+    return;
+  }
+  computeOutput(hidden, output);
+  for (int64_t i = 0; i < inputs.size(); i++) {
+    if (inputs[i].empty()) {
+      continue;
+    }
+    kernels::LogSumExp lse;
+    lse.add(output.row(i), osz_);
+    predictions[i].reserve(k + 1);
+    findKBest(k, threshold, output.row(i), lse.value(), predictions[i]);
+    std::sort_heap(predictions[i].begin(), predictions[i].end(),
+                   comparePairs);
+  }
+}
+
 void Model::findKBest(int32_t k, float threshold,
                       std::vector<std::pair<float, int32_t>>& heap,
                       Vector& hidden, Vector& output) const {
-  computeOutputSoftmax(hidden, output);
-  for (int32_t i = 0; i < osz_; i++) {
-    if (output[i] < threshold) continue;
-    if (heap.size() == k && std_log(output[i]) < heap.front().first) {
-      continue;
-    }
-    heap.push_back(std::make_pair(std_log(output[i]), i));
-    std::push_heap(heap.begin(), heap.end(), comparePairs);
-    if (heap.size() > k) {
-      std::pop_heap(heap.begin(), heap.end(), comparePairs);
-      heap.pop_back();
-    }
+  const float lse = computeOutput(hidden, output);
+  findKBest(k, threshold, output.data(), lse, heap);
+}
+
+// Selects the k best labels on their logits, keeping only those whose
+// probability exp(logit - lse) reaches threshold, and only then turns the
+// survivors into log-probabilities.
+void Model::findKBest(int32_t k, float threshold, const float* logits,
+                      float lse,
+                      std::vector<std::pair<float, int32_t>>& heap) const {
+  const float cutoff = threshold > 0.0
+                           ? std::log(threshold) + lse
+                           : -std::numeric_limits<float>::infinity();
+  kernels::topK(logits, osz_, k, cutoff, heap);
+  for (auto& pair : heap) {
+    pair.first = std_log(std::exp(pair.first - lse));
   }
 }
 
 void Model::dfs(int32_t k, float threshold, int32_t node, float score,
-                std::vector<std::pair<float, int32_t>>& heap,
-                Vector& hidden) const {
+                std::vector<std::pair<float, int32_t>>& heap, Vector& hidden,
+                const std::vector<float>& table) const {
   if (score < std_log(threshold)) return;
   if (heap.size() == k && score < heap.front().first) {
     return;
@@ -207,14 +380,61 @@ void Model::dfs(int32_t k, float threshold, int32_t node, float score,
 
   float f;
   if (quant_ && args_->qout) {
-    f = qwo_->dotRow(hidden, node - osz_);
+    f = qwo_->dotRow(table, node - osz_);
   } else {
     f = wo_->dotRow(hidden, node - osz_);
   }
-  f = 1. / (1 + std::exp(-f));
+  f = sigmoid(f);
+
+  dfs(k, threshold, tree[node].left, score + std_log(1.0 - f), heap, hidden,
+      table);
+  dfs(k, threshold, tree[node].right, score + std_log(f), heap, hidden, table);
+}
+
+// A NaN in the scores propagates to the loss, so the running loss is checked
+// once per example instead of every dot product.
+void Model::checkLoss() const {
+  if (std::isnan(loss_)) {
+    throw std::runtime_error("Encountered NaN.");
+  }
+}
 
-  dfs(k, threshold, tree[node].left, score + std_log(1.0 - f), heap, hidden);
-  dfs(k, threshold, tree[node].right, score + std_log(f), heap, hidden);
+// Adds grad_ to the input row of every id of input. An id that occurs n
+// times is updated once with n * grad_, so that each row is written once
+// per example. Ids are merged through slots_, an open-addressing table of
+// (id, index into rows_) pairs that is left empty again on return.
+void Model::addGradient(const std::vector<int32_t>& input) {
+  size_t size = 16;
+  while (size < 2 * input.size()) {
+    size *= 2;
+  }
+  if (slots_.size() < size) {
+    slots_.assign(size, std::make_pair(-1, 0));
+  }
+  const uint32_t mask = size - 1;
+  rows_.clear();
+  counts_.clear();
+  for (auto it = input.cbegin(); it != input.cend(); ++it) {
+    uint32_t h = (uint32_t(*it) * 2654435761u) & mask;
+    while (slots_[h].first >= 0 && slots_[h].first != *it) {
+      h = (h + 1) & mask;
+    }
+    if (slots_[h].first < 0) {
+      slots_[h] = std::make_pair(*it, int32_t(rows_.size()));
+      rows_.push_back(*it);
+      counts_.push_back(1.0);
+    } else {
+      counts_[slots_[h].second] += 1.0;
+    }
+  }
+  for (size_t i = 0; i < rows_.size(); i++) {
+    if (counts_[i] == 1.0) {
+      wi_->addRow(grad_, rows_[i]);
+    } else {
+      wi_->addRow(grad_, rows_[i], counts_[i]);
+    }
+  }
+  std::fill(slots_.begin(), slots_.begin() + size, std::make_pair(-1, 0));
 }
 
 void Model::update(const std::vector<int32_t>& input, int32_t target, float lr,
@@ -231,13 +451,12 @@ void Model::update(const std::vector<int32_t>& input, int32_t target, float lr,
     loss_ += softmax(target, lr);
   }
   nexamples_ += 1;
+  checkLoss();
 
   if (args_->model == model_name::sup) {
     grad_.mul(1.0 / input.size());
   }
-  for (auto it = input.cbegin(); it != input.cend(); ++it) {
-    wi_->addRow(grad_, *it);
-  }
+  addGradient(input);
 }
 
 void Model::update(const std::vector<int32_t>& input,
@@ -246,22 +465,26 @@ void Model::update(const std::vector<int32_t>& input,
   if (input.size() == 0 || line.size() < 2) return;
   computeHidden(input, hidden_);
   grad_.zero();
+  targets_.clear();
+  labels_.clear();
   for (int32_t c = -boundary; c <= boundary; ++c) {
     if (c != 0 && t + c >= 0 && t + c < line.size()) {
-      loss_ += binaryLogistic(line[t + c], true, lr, weight);
+      targets_.push_back(line[t + c]);
+      labels_.push_back(true);
       ++nexamples_;
     }
   }
   for (int32_t n = 0; n < args_->neg; ++n) {
-    loss_ += binaryLogistic(getNegative(line[t]), false, lr, weight);
+    targets_.push_back(getNegative(line[t]));
+    labels_.push_back(false);
   }
+  loss_ += binaryLogistic(targets_, labels_, lr, weight);
+  checkLoss();
 
   // Formally, the gradient must be divided by input.size().
   // Empirical results, however, are better without it.
   // grad_.mul(1.0 / input.size());
-  for (auto it = input.cbegin(); it != input.cend(); ++it) {
-    wi_->addRow(grad_, *it);
-  }
+  addGradient(input);
 }
 
 void Model::setTargetCounts(const std::vector<float>& weights) {
@@ -343,40 +566,10 @@ void Model::buildTree(const std::vector<float>& weights) {
 
 float Model::getLoss() const { return loss_ / nexamples_; }
 
-void Model::initSigmoid() {
-  for (int i = 0; i < SIGMOID_TABLE_SIZE + 1; i++) {
-    float x = float(i * 2 * MAX_SIGMOID) / SIGMOID_TABLE_SIZE - MAX_SIGMOID;
-    t_sigmoid_.push_back(1.0 / (1.0 + std::exp(-x)));
-  }
-}
-
-void Model::initLog() {
-  for (int i = 0; i < LOG_TABLE_SIZE + 1; i++) {
-    float x = (float(i) + 1e-5) / LOG_TABLE_SIZE;
-    t_log_.push_back(std::log(x));
-  }
-}
-
-float Model::log(float x) const {
-  if (x > 1.0) {
-    return 0.0;
-  }
-  int64_t i = int64_t(x * LOG_TABLE_SIZE);
-  return t_log_[i];
-}
+float Model::log(float x) const { return std_log(x); }
 
 float Model::std_log(float x) const { return std::log(x + 1e-5); }
 
-float Model::sigmoid(float x) const {
-  if (x < -MAX_SIGMOID) {
-    return 0.0;
-  } else if (x > MAX_SIGMOID) {
-    return 1.0;
-  } else {
-    int64_t i =
-        int64_t((x + MAX_SIGMOID) * SIGMOID_TABLE_SIZE / MAX_SIGMOID / 2);
-    return t_sigmoid_[i];
-  }
-}
+float Model::sigmoid(float x) const { return kernels::sigmoid(x); }
 
 }  // namespace fasttext
@@ -15,9 +15,11 @@
 #include <vector>
 
 #include "args.h"
+#include "kernels.h"
 #include "matrix.h"
 #include "qmatrix.h"
 #include "vector.h"
+#include "workerpool.h"
 
 namespace fasttext {
 
@@ -43,8 +45,19 @@ class Model {
   int32_t osz_;
   float loss_;
   int64_t nexamples_;
-  std::vector<float> t_sigmoid_;
-  std::vector<float> t_log_;
+  // scratch for the batched binaryLogistic:
+  std::vector<int32_t> targets_;
+  std::vector<bool> labels_;
+  std::vector<float> scores_;
+  std::vector<float> probs_;
+  // scratch for addGradient: the distinct input ids and their counts.
+  std::vector<int32_t> rows_;
+  std::vector<float> counts_;
+  std::vector<std::pair<int32_t, int32_t>> slots_;
+  // used by softmax with -softmaxThread: the helper threads and the
+  // gradients of their label ranges.
+  std::unique_ptr<WorkerPool> softmaxWorkers_;
+  std::vector<std::unique_ptr<Vector>> softmaxGrads_;
   // used for negative sampling:
   std::vector<int32_t> negatives_;
   size_t negpos;
@@ -57,8 +70,16 @@ class Model {
                            const std::pair<float, int32_t>&);
 
   int32_t getNegative(int32_t target);
-  void initSigmoid();
-  void initLog();
+  void findKBest(int32_t, float, const float*, float,
+                 std::vector<std::pair<float, int32_t>>&) const;
+  float computeOutput(Vector&, Vector&) const;
+  void computeLogits(const Vector&, Vector&, int64_t, int64_t,
+                     kernels::LogSumExp&) const;
+  void softmaxUpdate(int32_t, float, float, int64_t, int64_t, Vector&);
+  void computeOutput(Matrix&, Matrix&) const;
+  void checkLoss() const;
+  void sumInputRows(const std::vector<int32_t>&, float*) const;
+  void addGradient(const std::vector<int32_t>&);
 
   static const int32_t NEGATIVE_TABLE_SIZE = 10000000;
 
@@ -66,7 +87,8 @@ class Model {
   Model(std::shared_ptr<Matrix>, std::shared_ptr<Matrix>, std::shared_ptr<Args>,
         int32_t);
 
-  float binaryLogistic(int32_t, bool, float, float);
+  float binaryLogistic(const std::vector<int32_t>&, const std::vector<bool>&,
+                       float, float);
   float negativeSampling(int32_t, float, float);
   float hierarchicalSoftmax(int32_t, float);
   float softmax(int32_t, float);
@@ -75,8 +97,12 @@ class Model {
                std::vector<std::pair<float, int32_t>>&, Vector&, Vector&) const;
   void predict(const std::vector<int32_t>&, int32_t, float,
                std::vector<std::pair<float, int32_t>>&);
+  void predict(const std::vector<std::vector<int32_t>>&, int32_t, float,
+               std::vector<std::vector<std::pair<float, int32_t>>>&, Matrix&,
+               Matrix&) const;
   void dfs(int32_t, float, int32_t, float,
-           std::vector<std::pair<float, int32_t>>&, Vector&) const;
+           std::vector<std::pair<float, int32_t>>&, Vector&,
+           const std::vector<float>&) const;
   void findKBest(int32_t, float, std::vector<std::pair<float, int32_t>>&,
                  Vector&, Vector&) const;
   void update(const std::vector<int32_t>&, int32_t, float, float);
@@ -85,7 +111,9 @@ class Model {
               float lr, float weight);
 
   void computeHidden(const std::vector<int32_t>&, Vector&) const;
+  void computeHidden(const std::vector<std::vector<int32_t>>&, Matrix&) const;
   void computeOutputSoftmax(Vector&, Vector&) const;
+  void computeOutputSoftmax(Matrix&, Matrix&) const;
   void computeOutputSoftmax();
 
   void setTargetCounts(const std::vector<float>&);
@@ -10,33 +10,108 @@
 #include "productquantizer.h"
 
 #include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <limits>
 #include <numeric>
 #include <stdexcept>
+#include <thread>
+
+#include "affinity.h"
+#include "kernels.h"
 
 namespace fasttext {
 
 float distL2(const float* x, const float* y, int32_t d) {
-  float dist = 0;
-  for (auto i = 0; i < d; i++) {
-    auto tmp = x[i] - y[i];
-    dist += tmp * tmp;
+  return kernels::distL2(x, y, d);
+}
+
+// Lays out k centroids of dimension d as ct[j * k + i], so that the distance
+// loop below runs over contiguous centroids and vectorizes.
+static void transposeCentroids(const float* c, int32_t d, int32_t k,
+                               float* ct) {
+  for (auto i = 0; i < k; i++) {
+    for (auto j = 0; j < d; j++) {
+      ct[j * k + i] = c[i * d + j];
+    }
   }
-  return dist;
 }
 
-ProductQuantizer::ProductQuantizer(int32_t dim, int32_t dsub)
-    : dim_(dim),
-      nsubq_(dim / dsub),
-      dsub_(dsub),
-      centroids_(dim * ksub_),
-      rng(seed_) {
+static float nearestCentroid(const float* x, const float* ct, int32_t d,
+                             int32_t k, float* dis, uint8_t* code) {
+  std::fill(dis, dis + k, 0.0f);
+  for (auto j = 0; j < d; j++) {
+    const float xj = x[j];
+    const float* c = ct + j * k;
+    for (auto i = 0; i < k; i++) {
+      auto tmp = xj - c[i];
+      dis[i] += tmp * tmp;
+    }
+  }
+  // The minimum and its position are reduced over 8 independent lanes,
+  // which vectorizes where a single running argmin does not. Ties go to the
+  // first centroid, and a NaN distance is never selected.
+  float lanes[8];
+  int32_t positions[8];
+  for (auto l = 0; l < 8; l++) {
+    lanes[l] = std::numeric_limits<float>::infinity();
+    positions[l] = l;
+  }
+  for (auto i = 0; i < k; i += 8) {
+    for (auto l = 0; l < 8; l++) {
+      const bool less = dis[i + l] < lanes[l];
+      lanes[l] = less ? dis[i + l] : lanes[l];
+      positions[l] = less ? i + l : positions[l];
+    }
+  }
+  float mindis = lanes[0];
+  int32_t best = positions[0];
+  for (auto l = 1; l < 8; l++) {
+    if (lanes[l] < mindis || (lanes[l] == mindis && positions[l] < best)) {
+      mindis = lanes[l];
+      best = positions[l];
+    }
+  }
+  code[0] = (uint8_t)best;
+  return mindis;
+}
+
+ProductQuantizer::ProductQuantizer(int32_t dim, int32_t dsub, int32_t nbits)
+    : dim_(dim), nsubq_(dim / dsub), dsub_(dsub) {
   lastdsub_ = dim_ % dsub;
   if (lastdsub_ == 0) {
     lastdsub_ = dsub_;
   } else {
     nsubq_++;
   }
+  set_nbits(nbits);
+  centroids_.resize(dim * ksub_);
+}
+
+void ProductQuantizer::set_nbits(int32_t nbits) {
+  if (nbits != 4 && nbits != 8) {
+    throw std::invalid_argument("Codes must have 4 or 8 bits, not " +
+                                std::to_string(nbits));
+  }
+  nbits_ = nbits;
+  ksub_ = 1 << nbits_;
+  max_points_ = max_points_per_cluster_ * ksub_;
+}
+
+int32_t ProductQuantizer::get_nbits() const { return nbits_; }
+
+int32_t ProductQuantizer::get_nsubq() const { return nsubq_; }
+
+int64_t ProductQuantizer::code_size(int32_t n) const {
+  if (nbits_ == 8) {
+    return int64_t(n) * nsubq_;
+  }
+  return int64_t((n + 15) / 16) * ((nsubq_ + 1) / 2) * 16;
+}
+
+void ProductQuantizer::set_kmeans_options(bool kmeanspp, float tol) {
+  kmeanspp_ = kmeanspp;
+  tol_ = tol;
 }
 
 const float* ProductQuantizer::get_centroids(int32_t m, uint8_t i) const {
@@ -69,15 +144,22 @@ float ProductQuantizer::assign_centroid(const float* x, const float* c0,
   return dis;
 }
 
-void ProductQuantizer::Estep(const float* x, const float* centroids,
-                             uint8_t* codes, int32_t d, int32_t n) const {
+float ProductQuantizer::Estep(const float* x, const float* centroids,
+                              uint8_t* codes, int32_t d, int32_t n) const {
+  std::vector<float> ct(d * ksub_);
+  std::vector<float> dis(ksub_);
+  transposeCentroids(centroids, d, ksub_, ct.data());
+  double obj = 0.0;
   for (auto i = 0; i < n; i++) {
-    assign_centroid(x + i * d, centroids, codes + i, d);
+    obj += nearestCentroid(x + i * d, ct.data(), d, ksub_, dis.data(),
+                           codes + i);
   }
+  return obj;
 }
 
 void ProductQuantizer::MStep(const float* x0, float* centroids,
-                             const uint8_t* codes, int32_t d, int32_t n) {
+                             const uint8_t* codes, int32_t d, int32_t n,
+                             std::minstd_rand& rng) const {
   std::vector<int32_t> nelts(ksub_, 0);
   memset(centroids, 0, sizeof(float) * d * ksub_);
   const float* x = x0;
@@ -121,43 +203,107 @@ void ProductQuantizer::MStep(const float* x0, float* centroids,
   }
 }
 
-void ProductQuantizer::kmeans(const float* x, float* c, int32_t n, int32_t d) {
-  std::vector<int32_t> perm(n, 0);
-  std::iota(perm.begin(), perm.end(), 0);
-  std::shuffle(perm.begin(), perm.end(), rng);
-  for (auto i = 0; i < ksub_; i++) {
-    memcpy(&c[i * d], x + perm[i] * d, d * sizeof(float));
+void ProductQuantizer::init_centroids(const float* x, float* c, int32_t n,
+                                      int32_t d, std::minstd_rand& rng) const {
+  if (!kmeanspp_) {
+    std::vector<int32_t> perm(n, 0);
+    std::iota(perm.begin(), perm.end(), 0);
+    std::shuffle(perm.begin(), perm.end(), rng);
+    for (auto i = 0; i < ksub_; i++) {
+      memcpy(&c[i * d], x + perm[i] * d, d * sizeof(float));
+    }
+    return;
+  }
+  // k-means++: each new centroid is drawn with probability proportional to
+  // its squared distance to the closest centroid picked so far.
+  std::uniform_int_distribution<int32_t> uniform(0, n - 1);
+  std::uniform_real_distribution<> runiform(0, 1);
+  std::vector<float> mindis(n, std::numeric_limits<float>::max());
+  memcpy(c, x + uniform(rng) * d, d * sizeof(float));
+  for (auto k = 1; k < ksub_; k++) {
+    const float* last = c + (k - 1) * d;
+    double sum = 0.0;
+    for (auto i = 0; i < n; i++) {
+      mindis[i] = std::min(mindis[i], distL2(x + i * d, last, d));
+      sum += mindis[i];
+    }
+    int32_t pick = uniform(rng);
+    if (sum > 0) {
+      double r = runiform(rng) * sum;
+      for (auto i = 0; i < n; i++) {
+        r -= mindis[i];
+        if (r <= 0) {
+          pick = i;
+          break;
+        }
+      }
+    }
+    memcpy(c + k * d, x + pick * d, d * sizeof(float));
   }
+}
+
+void ProductQuantizer::kmeans(const float* x, float* c, int32_t n, int32_t d,
+                              std::minstd_rand& rng) const {
+  init_centroids(x, c, n, d, rng);
   auto codes = std::vector<uint8_t>(n);
+  float prev = 0.0;
   for (auto i = 0; i < niter_; i++) {
-    Estep(x, c, codes.data(), d, n);
-    MStep(x, c, codes.data(), d, n);
+    float obj = Estep(x, c, codes.data(), d, n);
+    if (tol_ > 0 && i > 0 && prev - obj <= tol_ * prev) {
+      break;
+    }
+    MStep(x, c, codes.data(), d, n, rng);
+    prev = obj;
   }
 }
 
-void ProductQuantizer::train(int32_t n, const float* x) {
+void ProductQuantizer::train_subquantizer(int32_t m, int32_t n,
+                                          const float* x) {
+  std::minstd_rand rng(seed_ + m);
+  auto d = (m == nsubq_ - 1) ? lastdsub_ : dsub_;
+  auto np = std::min(n, max_points_);
+  std::vector<int32_t> perm(n, 0);
+  std::iota(perm.begin(), perm.end(), 0);
+  if (np != n) {
+    std::shuffle(perm.begin(), perm.end(), rng);
+  }
+  auto xslice = std::vector<float>(np * d);
+  for (auto j = 0; j < np; j++) {
+    memcpy(xslice.data() + j * d, x + int64_t(perm[j]) * dim_ + m * dsub_,
+           d * sizeof(float));
+  }
+  kmeans(xslice.data(), get_centroids(m, 0), np, d, rng);
+}
+
+// Subquantizers are independent k-means problems: they are handed out to
+// the workers one at a time, each with its own seeded generator so that the
+// result does not depend on the number of threads.
+void ProductQuantizer::train(int32_t n, const float* x, int32_t nthreads) {
   if (n < ksub_) {
     throw std::invalid_argument(
         "Matrix too small for quantization, must have at least " +
         std::to_string(ksub_) + " rows");
   }
-  std::vector<int32_t> perm(n, 0);
-  std::iota(perm.begin(), perm.end(), 0);
-  auto d = dsub_;
-  auto np = std::min(n, max_points_);
-  auto xslice = std::vector<float>(np * dsub_);
-  for (auto m = 0; m < nsubq_; m++) {
-    if (m == nsubq_ - 1) {
-      d = lastdsub_;
-    }
-    if (np != n) {
-      std::shuffle(perm.begin(), perm.end(), rng);
+  nthreads = std::max(1, std::min(nthreads, nsubq_));
+  std::atomic<int32_t> next(0);
+  auto worker = [&]() {
+    for (int32_t m = next++; m < nsubq_; m = next++) {
+      train_subquantizer(m, n, x);
     }
-    for (auto j = 0; j < np; j++) {
-      memcpy(xslice.data() + j * d, x + perm[j] * dim_ + m * dsub_,
-             d * sizeof(float));
-    }
-    kmeans(xslice.data(), get_centroids(m, 0), np, d);
+  };
+  std::vector<std::thread> threads;
+  for (auto i = 1; i < nthreads; i++) {
+    threads.push_back(std::thread([&, i]() {
+      affinity::pin("quantize", i);
+      worker();
+    }));
+  }
+  {
+    affinity::ScopedPin pin("quantize", 0);
+    worker();
+  }
+  for (auto& t : threads) {
+    t.join();
   }
 }
 
@@ -165,9 +311,8 @@ float ProductQuantizer::mulcode(const Vector& x, const uint8_t* codes,
                                 int32_t t, float alpha) const {
   float res = 0.0;
   auto d = dsub_;
-  const uint8_t* code = codes + nsubq_ * t;
   for (auto m = 0; m < nsubq_; m++) {
-    const float* c = get_centroids(m, code[m]);
+    const float* c = get_centroids(m, get_code(codes, t, m));
     if (m == nsubq_ - 1) {
       d = lastdsub_;
     }
@@ -178,12 +323,89 @@ float ProductQuantizer::mulcode(const Vector& x, const uint8_t* codes,
   return res * alpha;
 }
 
+// Inner products between the sub-vectors of x and every centroid, laid out
+// as table[m * ksub_ + k]. Built once per query, it turns the scoring of a
+// code into nsubq_ table lookups.
+void ProductQuantizer::compute_ip_table(const Vector& x, float* table) const {
+  auto d = dsub_;
+  for (auto m = 0; m < nsubq_; m++) {
+    if (m == nsubq_ - 1) {
+      d = lastdsub_;
+    }
+    const float* xm = x.data() + m * dsub_;
+    const float* c = get_centroids(m, 0);
+    float* tm = table + m * ksub_;
+    for (auto k = 0; k < ksub_; k++) {
+      float dp = 0.0;
+      for (auto n = 0; n < d; n++) {
+        dp += xm[n] * c[n];
+      }
+      tm[k] = dp;
+      c += d;
+    }
+  }
+}
+
+int32_t ProductQuantizer::get_table_size() const { return nsubq_ * ksub_; }
+
+float ProductQuantizer::mulcode(const float* table, const uint8_t* codes,
+                                int32_t t, float alpha) const {
+  float res = 0.0;
+  for (auto m = 0; m < nsubq_; m++) {
+    res += table[m * ksub_ + get_code(codes, t, m)];
+  }
+  return res * alpha;
+}
+
+// Scores n consecutive codes against a table from compute_ip_table.
+void ProductQuantizer::mulcodes(const float* table, const uint8_t* codes,
+                                int32_t n, float* out) const {
+  if (nbits_ == 4) {
+    scan_packed(table, codes, n, out);
+    return;
+  }
+  kernels::pqScan8(table, codes, n, nsubq_, ksub_, out);
+}
+
+// Fast scan over 4-bit codes. The 16 entries of each subquantizer table are
+// quantized to bytes with a shared scale, so that a whole block of 16 rows is
+// looked up with a single byte shuffle per subquantizer and accumulated in
+// 16-bit lanes. Scores are approximate, to within nsubq_ / 2 quantization
+// steps of the exact table sum.
+void ProductQuantizer::scan_packed(const float* table, const uint8_t* codes,
+                                   int32_t n, float* out) const {
+  const int32_t npairs = (nsubq_ + 1) / 2;
+  std::vector<float> mins(nsubq_);
+  float bias = 0.0, range = 0.0;
+  for (auto m = 0; m < nsubq_; m++) {
+    const float* tm = table + m * ksub_;
+    const auto mm = std::minmax_element(tm, tm + ksub_);
+    mins[m] = *mm.first;
+    bias += *mm.first;
+    range = std::max(range, *mm.second - *mm.first);
+  }
+  const float scale = range > 0 ? 255.0f / range : 0.0f;
+  const float inv = range > 0 ? range / 255.0f : 0.0f;
+  std::vector<uint8_t> lut(2 * npairs * 16, 0);
+  for (auto m = 0; m < nsubq_; m++) {
+    for (auto k = 0; k < ksub_; k++) {
+      lut[m * 16 + k] =
+          (uint8_t)std::lround((table[m * ksub_ + k] - mins[m]) * scale);
+    }
+  }
+  kernels::pqScan4(lut.data(), codes, n, npairs, inv, bias, out);
+}
+
 void ProductQuantizer::addcode(Vector& x, const uint8_t* codes, int32_t t,
                                float alpha) const {
+  addcode(x.data(), codes, t, alpha);
+}
+
+void ProductQuantizer::addcode(float* x, const uint8_t* codes, int32_t t,
+                               float alpha) const {
   auto d = dsub_;
-  const uint8_t* code = codes + nsubq_ * t;
   for (auto m = 0; m < nsubq_; m++) {
-    const float* c = get_centroids(m, code[m]);
+    const float* c = get_centroids(m, get_code(codes, t, m));
     if (m == nsubq_ - 1) {
       d = lastdsub_;
     }
@@ -193,6 +415,23 @@ void ProductQuantizer::addcode(Vector& x, const uint8_t* codes, int32_t t,
   }
 }
 
+// Starts loading the cache lines that get_code reads for row t.
+void ProductQuantizer::prefetch_code(const uint8_t* codes, int32_t t) const {
+  const uint8_t* start;
+  int64_t size;
+  if (nbits_ == 8) {
+    start = codes + int64_t(nsubq_) * t;
+    size = nsubq_;
+  } else {
+    start = codes + int64_t(t / 16) * ((nsubq_ + 1) / 2) * 16;
+    size = ((nsubq_ + 1) / 2) * 16;
+  }
+  for (int64_t i = 0; i < size; i += 64) {
+    __builtin_prefetch(start + i);
+  }
+  __builtin_prefetch(start + size - 1);
+}
+
 void ProductQuantizer::compute_code(const float* x, uint8_t* code) const {
   auto d = dsub_;
   for (auto m = 0; m < nsubq_; m++) {
@@ -203,10 +442,60 @@ void ProductQuantizer::compute_code(const float* x, uint8_t* code) const {
   }
 }
 
+// Fills code_size(n) bytes of codes, in the layout of nbits_.
 void ProductQuantizer::compute_codes(const float* x, uint8_t* codes,
-                                     int32_t n) const {
-  for (auto i = 0; i < n; i++) {
-    compute_code(x + i * dim_, codes + i * nsubq_);
+                                     int32_t n, int32_t nthreads) const {
+  std::vector<std::vector<float>> ct(nsubq_);
+  for (auto m = 0; m < nsubq_; m++) {
+    auto d = (m == nsubq_ - 1) ? lastdsub_ : dsub_;
+    ct[m].resize(d * ksub_);
+    transposeCentroids(get_centroids(m, 0), d, ksub_, ct[m].data());
+  }
+  std::vector<uint8_t> unpacked;
+  uint8_t* dst = codes;
+  if (nbits_ != 8) {
+    unpacked.resize(int64_t(n) * nsubq_);
+    dst = unpacked.data();
+  }
+  auto worker = [&](int32_t begin, int32_t end) {
+    std::vector<float> dis(ksub_);
+    for (auto i = begin; i < end; i++) {
+      const float* xi = x + int64_t(i) * dim_;
+      uint8_t* code = dst + int64_t(i) * nsubq_;
+      auto d = dsub_;
+      for (auto m = 0; m < nsubq_; m++) {
+        if (m == nsubq_ - 1) {
+          d = lastdsub_;
+        }
+        nearestCentroid(xi + m * dsub_, ct[m].data(), d, ksub_, dis.data(),
+                        code + m);
+      }
+    }
+  };
+  nthreads = std::max(1, std::min(nthreads, n));
+  std::vector<std::thread> threads;
+  for (auto t = 1; t < nthreads; t++) {
+    threads.push_back(std::thread([&, t]() {
+      affinity::pin("quantize", t);
+      worker(int64_t(n) * t / nthreads, int64_t(n) * (t + 1) / nthreads);
+    }));
+  }
+  {
+    affinity::ScopedPin pin("quantize", 0);
+    worker(0, n / nthreads);
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  if (nbits_ != 8) {
+    const int32_t npairs = (nsubq_ + 1) / 2;
+    memset(codes, 0, code_size(n));
+    for (auto i = 0; i < n; i++) {
+      uint8_t* block = codes + int64_t(i / 16) * npairs * 16 + i % 16;
+      for (auto m = 0; m < nsubq_; m++) {
+        block[(m / 2) * 16] |= unpacked[int64_t(i) * nsubq_ + m] << 4 * (m % 2);
+      }
+    }
   }
 }
 
@@ -219,7 +508,8 @@ void ProductQuantizer::save(std::ostream& out) {
             centroids_.size() * sizeof(*centroids_.data()));
 }
 
-void ProductQuantizer::load(std::istream& in) {
+void ProductQuantizer::load(std::istream& in, int32_t nbits) {
+  set_nbits(nbits);
   in.read((char*)&dim_, sizeof(dim_));
   in.read((char*)&nsubq_, sizeof(nsubq_));
   in.read((char*)&dsub_, sizeof(dsub_));
@@ -21,14 +21,21 @@ namespace fasttext {
 
 class ProductQuantizer {
  protected:
-  const int32_t nbits_ = 8;
-  const int32_t ksub_ = 1 << nbits_;
+  // Codes of 8 bits take one byte per subquantizer and row. Codes of 4 bits
+  // are packed two per byte in blocks of 16 rows: byte (b * npairs + p) *
+  // 16 + r holds subquantizers 2p (low nibble) and 2p+1 (high nibble) of row
+  // 16b + r, so that a block is scored with one byte shuffle per nibble.
+  int32_t nbits_ = 8;
+  int32_t ksub_ = 1 << nbits_;
   const int32_t max_points_per_cluster_ = 256;
-  const int32_t max_points_ = max_points_per_cluster_ * ksub_;
+  int32_t max_points_ = max_points_per_cluster_ * ksub_;
   const int32_t seed_ = 1234;
   const int32_t niter_ = 25;
   const float eps_ = 1e-7;
 
+  bool kmeanspp_ = false;
+  float tol_ = 0.0;
+
   int32_t dim_;
   int32_t nsubq_;
   int32_t dsub_;
@@ -36,28 +43,63 @@ class ProductQuantizer {
 
   std::vector<float> centroids_;
 
-  std::minstd_rand rng;
+  void train_subquantizer(int32_t, int32_t, const float*);
+  void init_centroids(const float*, float*, int32_t, int32_t,
+                      std::minstd_rand&) const;
+  void set_nbits(int32_t);
+  void scan_packed(const float*, const uint8_t*, int32_t, float*) const;
 
  public:
   ProductQuantizer() {}
-  ProductQuantizer(int32_t, int32_t);
+  ProductQuantizer(int32_t, int32_t, int32_t nbits = 8);
+
+  inline uint8_t get_code(const uint8_t* codes, int32_t t, int32_t m) const {
+    if (nbits_ == 8) {
+      return codes[nsubq_ * t + m];
+    }
+    const uint8_t c =
+        codes[((t / 16) * ((nsubq_ + 1) / 2) + m / 2) * 16 + t % 16];
+    return (m % 2) ? c >> 4 : c & 0x0f;
+  }
+  inline void set_code(uint8_t* codes, int32_t t, int32_t m,
+                       uint8_t code) const {
+    if (nbits_ == 8) {
+      codes[nsubq_ * t + m] = code;
+      return;
+    }
+    uint8_t& c = codes[((t / 16) * ((nsubq_ + 1) / 2) + m / 2) * 16 + t % 16];
+    c = (m % 2) ? (c & 0x0f) | (code << 4) : (c & 0xf0) | code;
+  }
+  int32_t get_nbits() const;
+  int32_t get_nsubq() const;
+  int64_t code_size(int32_t) const;
 
   float* get_centroids(int32_t, uint8_t);
   const float* get_centroids(int32_t, uint8_t) const;
 
+  void set_kmeans_options(bool, float);
+
   float assign_centroid(const float*, const float*, uint8_t*, int32_t) const;
-  void Estep(const float*, const float*, uint8_t*, int32_t, int32_t) const;
-  void MStep(const float*, float*, const uint8_t*, int32_t, int32_t);
-  void kmeans(const float*, float*, int32_t, int32_t);
-  void train(int, const float*);
+  float Estep(const float*, const float*, uint8_t*, int32_t, int32_t) const;
+  void MStep(const float*, float*, const uint8_t*, int32_t, int32_t,
+             std::minstd_rand&) const;
+  void kmeans(const float*, float*, int32_t, int32_t, std::minstd_rand&) const;
+  void train(int32_t, const float*, int32_t nthreads = 1);
 
   float mulcode(const Vector&, const uint8_t*, int32_t, float) const;
+  float mulcode(const float*, const uint8_t*, int32_t, float) const;
+  void mulcodes(const float*, const uint8_t*, int32_t, float*) const;
+  void compute_ip_table(const Vector&, float*) const;
+  int32_t get_table_size() const;
   void addcode(Vector&, const uint8_t*, int32_t, float) const;
+  void addcode(float*, const uint8_t*, int32_t, float) const;
+  void prefetch_code(const uint8_t*, int32_t) const;
   void compute_code(const float*, uint8_t*) const;
-  void compute_codes(const float*, uint8_t*, int32_t) const;
+  void compute_codes(const float*, uint8_t*, int32_t,
+                     int32_t nthreads = 1) const;
 
   void save(std::ostream&);
-  void load(std::istream&);
+  void load(std::istream&, int32_t nbits = 8);
 };
 
 }  // namespace fasttext
@@ -10,47 +10,64 @@
 #include "qmatrix.h"
 
 #include <assert.h>
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 
+#include "kernels.h"
+
 namespace fasttext {
 
-QMatrix::QMatrix() : qnorm_(false), m_(0), n_(0), codesize_(0) {}
+QMatrix::QMatrix() : qnorm_(false), nbits_(8), m_(0), n_(0), codesize_(0) {}
 
-QMatrix::QMatrix(const Matrix& mat, int32_t dsub, bool qnorm)
-    : qnorm_(qnorm),
-      m_(mat.size(0)),
-      n_(mat.size(1)),
-      codesize_(m_ * ((n_ + dsub - 1) / dsub)) {
+QMatrix::QMatrix(const Matrix& mat, int32_t dsub, bool qnorm, int32_t nthreads,
+                 bool kmeanspp, float tol, int32_t nbits)
+    : qnorm_(qnorm), nbits_(nbits), m_(mat.size(0)), n_(mat.size(1)) {
+  pq_ = std::unique_ptr<ProductQuantizer>(
+      new ProductQuantizer(n_, dsub, nbits_));
+  codesize_ = pq_->code_size(m_);
   codes_.resize(codesize_);
-  pq_ = std::unique_ptr<ProductQuantizer>(new ProductQuantizer(n_, dsub));
+  pq_->set_kmeans_options(kmeanspp, tol);
   if (qnorm_) {
     norm_codes_.resize(m_);
     npq_ = std::unique_ptr<ProductQuantizer>(new ProductQuantizer(1, 1));
+    npq_->set_kmeans_options(kmeanspp, tol);
   }
-  quantize(mat);
+  quantize(mat, nthreads);
 }
 
-void QMatrix::quantizeNorm(const Vector& norms) {
+void QMatrix::quantizeNorm(const Vector& norms, int32_t nthreads) {
   assert(qnorm_);
   assert(norms.size() == m_);
   auto dataptr = norms.data();
   npq_->train(m_, dataptr);
-  npq_->compute_codes(dataptr, norm_codes_.data(), m_);
+  npq_->compute_codes(dataptr, norm_codes_.data(), m_, nthreads);
 }
 
-void QMatrix::quantize(const Matrix& matrix) {
+void QMatrix::quantize(const Matrix& matrix, int32_t nthreads) {
   assert(m_ == matrix.size(0));
   assert(n_ == matrix.size(1));
-  Matrix temp(matrix);
+  // Matrix rows are padded to a 64-byte stride, the quantizer works on
+  // densely packed rows.
+  std::vector<float> temp(m_ * n_);
+  for (int64_t i = 0; i < m_; i++) {
+    memcpy(temp.data() + i * n_, matrix.row(i), n_ * sizeof(float));
+  }
   if (qnorm_) {
-    Vector norms(temp.size(0));
-    temp.l2NormRow(norms);
-    temp.divideRow(norms);
-    quantizeNorm(norms);
+    Vector norms(m_);
+    matrix.l2NormRow(norms);
+    for (int64_t i = 0; i < m_; i++) {
+      if (norms[i] != 0) {
+        for (int64_t j = 0; j < n_; j++) {
+          temp[i * n_ + j] /= norms[i];
+        }
+      }
+    }
+    quantizeNorm(norms, nthreads);
   }
   auto dataptr = temp.data();
-  pq_->train(m_, dataptr);
-  pq_->compute_codes(dataptr, codes_.data(), m_);
+  pq_->train(m_, dataptr, nthreads);
+  pq_->compute_codes(dataptr, codes_.data(), m_, nthreads);
 }
 
 void QMatrix::addToVector(Vector& x, int32_t t) const {
@@ -61,6 +78,36 @@ void QMatrix::addToVector(Vector& x, int32_t t) const {
   pq_->addcode(x, codes_.data(), t, norm);
 }
 
+// Rows ids[k] decoded into out, each times weights[k] unless weights is
+// null. The codes are prefetched a few ids ahead, as in Matrix::sumRows.
+void QMatrix::sumRows(const int32_t* ids, int64_t n, const float* weights,
+                      float* out) const {
+  for (int64_t k = 0; k < std::min(n, kernels::SUM_ROWS_AHEAD); k++) {
+    prefetchRow(ids[k]);
+  }
+  for (int64_t k = 0; k < n; k++) {
+    if (k + kernels::SUM_ROWS_AHEAD < n) {
+      prefetchRow(ids[k + kernels::SUM_ROWS_AHEAD]);
+    }
+    const int32_t t = ids[k];
+    float norm = 1;
+    if (qnorm_) {
+      norm = npq_->get_centroids(0, norm_codes_[t])[0];
+    }
+    if (weights != nullptr) {
+      norm *= weights[k];
+    }
+    pq_->addcode(out, codes_.data(), t, norm);
+  }
+}
+
+void QMatrix::prefetchRow(int32_t t) const {
+  pq_->prefetch_code(codes_.data(), t);
+  if (qnorm_) {
+    __builtin_prefetch(norm_codes_.data() + t);
+  }
+}
+
 float QMatrix::dotRow(const Vector& vec, int64_t i) const {
   assert(i >= 0);
   assert(i < m_);
@@ -72,12 +119,41 @@ float QMatrix::dotRow(const Vector& vec, int64_t i) const {
   return pq_->mulcode(vec, codes_.data(), i, norm);
 }
 
+void QMatrix::computeTable(const Vector& vec, std::vector<float>& table) const {
+  assert(vec.size() == n_);
+  table.resize(pq_->get_table_size());
+  pq_->compute_ip_table(vec, table.data());
+}
+
+float QMatrix::dotRow(const std::vector<float>& table, int64_t i) const {
+  assert(i >= 0);
+  assert(i < m_);
+  float norm = 1;
+  if (qnorm_) {
+    norm = npq_->get_centroids(0, norm_codes_[i])[0];
+  }
+  return pq_->mulcode(table.data(), codes_.data(), i, norm);
+}
+
+void QMatrix::dotRows(const Vector& vec, Vector& out) const {
+  assert(out.size() == m_);
+  std::vector<float> table;
+  computeTable(vec, table);
+  pq_->mulcodes(table.data(), codes_.data(), m_, out.data());
+  if (qnorm_) {
+    for (int64_t i = 0; i < m_; i++) {
+      out[i] *= npq_->get_centroids(0, norm_codes_[i])[0];
+    }
+  }
+}
+
 int64_t QMatrix::getM() const { return m_; }
 
 int64_t QMatrix::getN() const { return n_; }
 
 void QMatrix::save(std::ostream& out) {
   out.write((char*)&qnorm_, sizeof(qnorm_));
+  out.write((char*)&nbits_, sizeof(nbits_));
   out.write((char*)&m_, sizeof(m_));
   out.write((char*)&n_, sizeof(n_));
   out.write((char*)&codesize_, sizeof(codesize_));
@@ -89,15 +165,20 @@ void QMatrix::save(std::ostream& out) {
   }
 }
 
-void QMatrix::load(std::istream& in) {
+void QMatrix::load(std::istream& in, int32_t version) {
   in.read((char*)&qnorm_, sizeof(qnorm_));
+  // Models saved before version 13 only have 8-bit codes.
+  nbits_ = 8;
+  if (version >= 13) {
+    in.read((char*)&nbits_, sizeof(nbits_));
+  }
   in.read((char*)&m_, sizeof(m_));
   in.read((char*)&n_, sizeof(n_));
   in.read((char*)&codesize_, sizeof(codesize_));
   codes_ = std::vector<uint8_t>(codesize_);
   in.read((char*)codes_.data(), codesize_ * sizeof(*codes_.data()));
   pq_ = std::unique_ptr<ProductQuantizer>(new ProductQuantizer());
-  pq_->load(in);
+  pq_->load(in, nbits_);
   if (qnorm_) {
     norm_codes_ = std::vector<uint8_t>(m_);
     in.read((char*)norm_codes_.data(), m_ * sizeof(*norm_codes_.data()));
@@ -32,27 +32,35 @@ class QMatrix {
   std::vector<uint8_t> norm_codes_;
 
   bool qnorm_;
+  int32_t nbits_;
 
   int64_t m_;
   int64_t n_;
 
   int32_t codesize_;
 
+  void prefetchRow(int32_t) const;
+
  public:
   QMatrix();
-  QMatrix(const Matrix&, int32_t, bool);
+  QMatrix(const Matrix&, int32_t, bool, int32_t nthreads = 1,
+          bool kmeanspp = false, float tol = 0.0, int32_t nbits = 8);
 
   int64_t getM() const;
   int64_t getN() const;
 
-  void quantizeNorm(const Vector&);
-  void quantize(const Matrix&);
+  void quantizeNorm(const Vector&, int32_t nthreads = 1);
+  void quantize(const Matrix&, int32_t nthreads = 1);
 
   void addToVector(Vector& x, int32_t t) const;
+  void sumRows(const int32_t*, int64_t, const float*, float*) const;
   float dotRow(const Vector&, int64_t) const;
+  float dotRow(const std::vector<float>&, int64_t) const;
+  void dotRows(const Vector&, Vector&) const;
+  void computeTable(const Vector&, std::vector<float>&) const;
 
   void save(std::ostream&);
-  void load(std::istream&);
+  void load(std::istream&, int32_t);
 };
 
 }  // namespace fasttext
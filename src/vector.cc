@@ -14,48 +14,46 @@
 #include <cmath>
 #include <iomanip>
 
-#include <ipp.h>
+#include "backend.h"
 #include "matrix.h"
 #include "qmatrix.h"
 
 namespace fasttext {
 
-Vector::~Vector() { ippsFree(data_); }
+Vector::~Vector() { backend::release(data_); }
 
 Vector::Vector(std::size_t m) : size_(m) {
-  data_ = static_cast<float *>(ippsMalloc_32f_L(size_));
+  data_ = backend::allocate(size_);
 }
 
-void Vector::zero() { ippsZero_32f(data_, size_); }
+void Vector::zero() { backend::zero(data_, size_); }
 
 float Vector::norm() const {
-  float norm;
-  ippsNorm_L2_32f(data_, size_, &norm);
-  return norm;
+  return backend::norm(data_, size_);
 }
 
-void Vector::mul(float a) { ippsMulC_32f_I(a, data_, size_); }
+void Vector::mul(float a) { backend::scale(a, data_, size_); }
 
 void Vector::addVector(const Vector &source) {
   assert(size() == source.size());
-  ippsAdd_32f_I(source.data(), data_, size_);
+  backend::add(source.data(), data_, size_);
 }
 
 void Vector::addVector(const Vector &source, float a) {
   assert(size() == source.size());
-  ippsAddProductC_32f(source.data(), a, data_, size_);
+  backend::axpy(a, source.data(), data_, size_);
 }
 
 void Vector::addRow(const Matrix &A, std::size_t i) {
   assert(i < A.size(0));
   assert(size() == A.size(1));
-  ippsAdd_32f_I(A.row(i), data_, size_);
+  backend::add(A.row(i), data_, size_);
 }
 
 void Vector::addRow(const Matrix &A, std::size_t i, float a) {
   assert(i < A.size(0));
   assert(size() == A.size(1));
-  ippsAddProductC_32f(A.row(i), a, data_, size_);
+  backend::axpy(a, A.row(i), data_, size_);
 }
 
 void Vector::addRow(const QMatrix &A, std::size_t i) {
@@ -74,9 +72,7 @@ void Vector::mul(const Matrix &A, const Vector &vec) {
 void Vector::mul(const QMatrix &A, const Vector &vec) {
   assert(A.getM() == size());
   assert(A.getN() == vec.size());
-  for (std::size_t i = 0; i < size(); i++) {
-    data_[i] = A.dotRow(vec, i);
-  }
+  A.dotRows(vec, *this);
 }
 
 std::size_t Vector::argmax() {
@@ -0,0 +1,72 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "workerpool.h"
+
+#include "affinity.h"
+
+namespace fasttext {
+
+WorkerPool::WorkerPool(int32_t size)
+    : task_(nullptr), generation_(0), pending_(0), stop_(false) {
+  for (int32_t t = 1; t < size; t++) {
+    threads_.push_back(std::thread([this, t]() { work(t); }));
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  start_.notify_all();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+int32_t WorkerPool::size() const {
+  return threads_.size() + 1;
+}
+
+void WorkerPool::run(const Task& task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    task_ = &task;
+    pending_ = threads_.size();
+    generation_++;
+  }
+  start_.notify_all();
+  task(0);
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_.wait(lock, [this]() { return pending_ == 0; });
+  task_ = nullptr;
+}
+
+void WorkerPool::work(int32_t index) {
+  affinity::unpin();
+  int64_t generation = 0;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    start_.wait(lock, [&]() { return stop_ || generation_ != generation; });
+    if (stop_) {
+      return;
+    }
+    generation = generation_;
+    const Task& task = *task_;
+    lock.unlock();
+    task(index);
+    lock.lock();
+    if (--pending_ == 0) {
+      done_.notify_one();
+    }
+  }
+}
+
+}  // namespace fasttext
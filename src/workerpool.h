@@ -0,0 +1,53 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace fasttext {
+
+// Helper threads kept for the lifetime of their owner, for work that is
+// split many times a second, such as every softmax update: run(task) calls
+// task(t) for t in [1, size()) on the helpers and task(0) on the calling
+// thread, and returns once all of them are done. Handing out a task wakes
+// the helpers instead of creating them. The helpers are not pinned, as they
+// are usually started from a pinned training thread.
+class WorkerPool {
+ public:
+  typedef std::function<void(int32_t)> Task;
+
+  explicit WorkerPool(int32_t);
+  ~WorkerPool();
+  WorkerPool(const WorkerPool&) = delete;
+  WorkerPool& operator=(const WorkerPool&) = delete;
+
+  int32_t size() const;
+  void run(const Task&);
+
+ private:
+  std::vector<std::thread> threads_;
+  std::mutex mutex_;
+  std::condition_variable start_;
+  std::condition_variable done_;
+  const Task* task_;
+  // Incremented for every task, so that each helper runs it once.
+  int64_t generation_;
+  int32_t pending_;
+  bool stop_;
+
+  void work(int32_t);
+};
+
+}  // namespace fasttext
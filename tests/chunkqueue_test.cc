@@ -0,0 +1,68 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <set>
+#include <string>
+
+#include "chunkqueue.h"
+#include "test.h"
+
+using namespace fasttext;
+
+namespace {
+
+std::string writeFile(const std::string& contents) {
+  char name[] = "/tmp/chunkqueue_testXXXXXX";
+  const int fd = mkstemp(name);
+  close(fd);
+  std::ofstream(name, std::ofstream::binary) << contents;
+  return name;
+}
+
+// Each epoch hands out every chunk exactly once, however the threads
+// interleave.
+void checkEpochs(const std::string& contents, int32_t nthreads) {
+  const std::string filename = writeFile(contents);
+  ChunkQueue queue(filename, nthreads, 1, 0);
+  std::map<int64_t, std::multiset<int64_t>> epochs;
+  for (int32_t round = 0; round < 100; round++) {
+    for (int32_t t = 0; t < nthreads; t++) {
+      const ChunkQueue::Chunk chunk = queue.next((t * 7 + round) % nthreads);
+      epochs[chunk.epoch].insert(chunk.begin);
+    }
+  }
+  unlink(filename.c_str());
+  bool ok = epochs.size() > 1;
+  for (auto it = epochs.begin(); std::next(it) != epochs.end(); ++it) {
+    const std::set<int64_t> distinct(it->second.begin(), it->second.end());
+    ok = ok && int64_t(it->second.size()) == queue.size() &&
+        distinct.size() == it->second.size();
+  }
+  CHECK(ok);
+}
+
+TEST(moreChunksThanThreads) {
+  checkEpochs("a\nb\nc\nd\ne\nf\ng\nh\ni\nj\nk\nl\n", 2);
+}
+
+TEST(fewerChunksThanThreads) {
+  checkEpochs("a b\nc d\ne f\n", 12);
+}
+
+}  // namespace
+
+int main() {
+  return test::runAll();
+}
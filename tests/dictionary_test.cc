@@ -0,0 +1,171 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "args.h"
+#include "dictionary.h"
+#include "test.h"
+
+using namespace fasttext;
+
+namespace {
+
+// Supervised settings without subwords, that keep every token.
+std::shared_ptr<Args> supervisedArgs() {
+  std::shared_ptr<Args> args = std::make_shared<Args>();
+  args->model = model_name::sup;
+  args->minCount = 1;
+  args->minn = 0;
+  args->maxn = 0;
+  args->bucket = 0;
+  args->wordNgrams = 1;
+  args->t = 1.0;
+  args->verbose = 0;
+  return args;
+}
+
+std::shared_ptr<Dictionary> readDictionary(std::shared_ptr<Args> args,
+                                           const std::string& text) {
+  std::shared_ptr<Dictionary> dict = std::make_shared<Dictionary>(args);
+  std::istringstream in(text);
+  dict->readFromFile(in);
+  return dict;
+}
+
+// Words with punctuation and labels with punctuation are single tokens
+// when the dictionary is built and when lines are read back.
+TEST(punctuationStaysInTokens) {
+  std::shared_ptr<Dictionary> dict =
+      readDictionary(supervisedArgs(), "__label__yes-no don't stop.\n");
+  CHECK(dict->nwords() == 2);
+  CHECK(dict->nlabels() == 1);
+  CHECK(dict->getId("don't") >= 0);
+  CHECK(dict->getId("stop.") >= 0);
+  CHECK(dict->getId("don") < 0);
+  CHECK(dict->getLabel(0) == "__label__yes-no");
+
+  std::istringstream line("__label__yes-no don't stop.\n");
+  std::vector<int32_t> words, labels;
+  CHECK(dict->getLine(line, words, labels) == 3);
+  CHECK(words == std::vector<int32_t>(
+                     {dict->getId("don't"), dict->getId("stop.")}));
+  CHECK(labels == std::vector<int32_t>({0}));
+}
+
+// getLine, convertLine and readFromFile skip the weight column.
+TEST(weightColumn) {
+  std::shared_ptr<Args> args = supervisedArgs();
+  args->has_weight = true;
+  std::shared_ptr<Dictionary> dict =
+      readDictionary(args, "1.5 __label__a b c\n2 __label__a c\n");
+  CHECK(dict->nwords() == 2);
+  CHECK(dict->getId("1.5") < 0);
+  CHECK(dict->getId("2") < 0);
+
+  std::istringstream line("1.5 __label__a b c\n");
+  std::vector<int32_t> words, labels;
+  CHECK(dict->getLine(line, words, labels) == 3);
+  CHECK(words ==
+        std::vector<int32_t>({dict->getId("b"), dict->getId("c")}));
+  CHECK(labels.size() == 1);
+
+  std::minstd_rand rng(1);
+  float weight = 0.0;
+  CHECK(dict->convertLine("2 b c", rng, &words, &weight) == 2);
+  CHECK(weight == 2.0f);
+  CHECK(words ==
+        std::vector<int32_t>({dict->getId("b"), dict->getId("c")}));
+}
+
+// Skipgram settings with character n-grams from minn to maxn.
+std::shared_ptr<Args> subwordArgs(int minn, int maxn, int bucket) {
+  std::shared_ptr<Args> args = supervisedArgs();
+  args->model = model_name::sg;
+  args->minn = minn;
+  args->maxn = maxn;
+  args->bucket = bucket;
+  return args;
+}
+
+// -minn 0 -maxn 0 -bucket 0, the supervised defaults: no subwords, and no
+// hash taken modulo the empty bucket range.
+TEST(noSubwordsWithoutBuckets) {
+  std::shared_ptr<Dictionary> dict =
+      readDictionary(subwordArgs(0, 0, 0), "ab cde ab\n");
+  CHECK(dict->getSubwords("ab") == std::vector<int32_t>({dict->getId("ab")}));
+  CHECK(dict->getSubwords("xyz").empty());
+}
+
+// An n-gram of length 0 is empty: -minn 0 gives the subwords of -minn 1,
+// with no rows for the bare "<", ">" or "" markers.
+TEST(minn0MatchesMinn1) {
+  const std::string text = "ab cde ab\n";
+  std::shared_ptr<Dictionary> dict0 =
+      readDictionary(subwordArgs(0, 2, 1000), text);
+  std::shared_ptr<Dictionary> dict1 =
+      readDictionary(subwordArgs(1, 2, 1000), text);
+  // "<a", "b>" and "<ab>", after the word itself.
+  CHECK(dict0->getSubwords("ab").size() == 4);
+  for (const std::string word : {"ab", "cde", "xyz"}) {
+    CHECK(dict0->getSubwords(word) == dict1->getSubwords(word));
+  }
+}
+
+// Labels have no row of their own among the words: getSubwords treats them
+// as out-of-vocabulary words, so getWordVector on a label gives the sum of
+// its character n-grams, if any.
+TEST(labelsAreOutOfVocabulary) {
+  std::shared_ptr<Dictionary> dict =
+      readDictionary(supervisedArgs(), "__label__a b c\n");
+  CHECK(dict->getId("__label__a") >= dict->nwords());
+  CHECK(dict->getSubwords("__label__a").empty());
+
+  std::shared_ptr<Args> args = supervisedArgs();
+  args->minn = 2;
+  args->maxn = 3;
+  args->bucket = 1000;
+  dict = readDictionary(args, "__label__a b c\n");
+  const std::vector<int32_t> subwords = dict->getSubwords("__label__a");
+  CHECK(!subwords.empty());
+  CHECK(subwords == dict->computeSubwords("__label__a", args->minn,
+                                          args->maxn, Dictionary::BOW,
+                                          Dictionary::EOW));
+}
+
+// Pruning renumbers the words it keeps; their discard probabilities move
+// with them.
+TEST(pruneKeepsDiscardProbabilities) {
+  std::shared_ptr<Args> args = subwordArgs(0, 0, 0);
+  args->t = 0.01;
+  const std::string text = "a b b c c c c d d d d d d d d\n";
+  std::shared_ptr<Dictionary> full = readDictionary(args, text);
+  std::shared_ptr<Dictionary> pruned = readDictionary(args, text);
+  std::vector<int32_t> idx = {pruned->getId("c"), pruned->getId("a")};
+  pruned->prune(idx);
+  CHECK(pruned->nwords() == 2);
+  bool same = true;
+  for (const std::string word : {"a", "c"}) {
+    for (float rand = 0.0; rand < 1.0; rand += 0.01) {
+      same = same && pruned->discard(pruned->getId(word), rand) ==
+                         full->discard(full->getId(word), rand);
+    }
+  }
+  CHECK(same);
+}
+
+}  // namespace
+
+int main() {
+  return test::runAll();
+}
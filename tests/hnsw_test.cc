@@ -0,0 +1,102 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "hnsw.h"
+#include "matrix.h"
+#include "test.h"
+#include "vector.h"
+
+using namespace fasttext;
+
+namespace {
+
+constexpr int32_t DIM = 8;
+constexpr int32_t ROWS = 300;
+
+// Random unit rows.
+void randomRows(Matrix& x, uint32_t seed) {
+  std::minstd_rand rng(seed);
+  std::normal_distribution<float> normal;
+  for (int64_t i = 0; i < x.rows(); i++) {
+    float norm = 0.0;
+    for (int64_t j = 0; j < x.cols(); j++) {
+      x.at(i, j) = normal(rng);
+      norm += x.at(i, j) * x.at(i, j);
+    }
+    for (int64_t j = 0; j < x.cols(); j++) {
+      x.at(i, j) /= std::sqrt(norm);
+    }
+  }
+}
+
+std::string savedIndex(const Matrix& x) {
+  HNSWIndex index(8, 50);
+  index.build(x, 1);
+  std::ostringstream out;
+  index.save(out);
+  return out.str();
+}
+
+void loadIndex(const std::string& data) {
+  std::istringstream in(data);
+  HNSWIndex index;
+  index.load(in);
+}
+
+// The loaded index gives the same neighbours as the one that was saved.
+TEST(roundTrip) {
+  Matrix x(ROWS, DIM);
+  randomRows(x, 1);
+  HNSWIndex index(8, 50);
+  index.build(x, 1);
+  std::stringstream file;
+  index.save(file);
+  HNSWIndex loaded;
+  loaded.load(file);
+  CHECK(loaded.size() == ROWS);
+  CHECK(loaded.dim() == DIM);
+
+  Vector query(DIM);
+  bool same = true;
+  for (int32_t i = 0; i < ROWS; i += 37) {
+    std::copy(x.row(i), x.row(i) + DIM, query.data());
+    std::vector<std::pair<float, int32_t>> expected, actual;
+    index.search(x, query, 5, 20, expected);
+    loaded.search(x, query, 5, 20, actual);
+    same = same && expected == actual;
+  }
+  CHECK(same);
+}
+
+// A file cut anywhere after its header is rejected rather than loaded
+// with garbage links.
+TEST(rejectsTruncatedFile) {
+  Matrix x(ROWS, DIM);
+  randomRows(x, 2);
+  const std::string data = savedIndex(x);
+  for (std::size_t size : {std::size_t(12), data.size() / 2,
+                           data.size() - 1}) {
+    CHECK_THROWS(loadIndex(data.substr(0, size)), std::invalid_argument);
+  }
+}
+
+}  // namespace
+
+int main() {
+  return test::runAll();
+}
@@ -0,0 +1,114 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <cmath>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "ivfpq.h"
+#include "matrix.h"
+#include "test.h"
+#include "vector.h"
+
+using namespace fasttext;
+
+namespace {
+
+constexpr int32_t DIM = 16;
+constexpr int32_t ROWS = 2000;
+constexpr int32_t NLIST = 8;
+
+// Random unit rows.
+void randomRows(Matrix& x, uint32_t seed) {
+  std::minstd_rand rng(seed);
+  std::normal_distribution<float> normal;
+  for (int64_t i = 0; i < x.rows(); i++) {
+    float norm = 0.0;
+    for (int64_t j = 0; j < x.cols(); j++) {
+      x.at(i, j) = normal(rng);
+      norm += x.at(i, j) * x.at(i, j);
+    }
+    for (int64_t j = 0; j < x.cols(); j++) {
+      x.at(i, j) /= std::sqrt(norm);
+    }
+  }
+}
+
+// Rows are added in two batches whose sizes are not multiples of 16, so
+// that packed 4-bit lists are extended across partial blocks. The loaded
+// index must give the same results as the one that was saved.
+void checkRoundTrip(int32_t nbits) {
+  Matrix x(ROWS, DIM);
+  randomRows(x, 1);
+  IVFPQIndex index(DIM, NLIST, 2, nbits);
+  index.train(x, 1);
+  const int32_t half = 997;
+  Matrix first(half, DIM), second(ROWS - half, DIM);
+  for (int64_t i = 0; i < ROWS; i++) {
+    for (int64_t j = 0; j < DIM; j++) {
+      if (i < half) {
+        first.at(i, j) = x.at(i, j);
+      } else {
+        second.at(i - half, j) = x.at(i, j);
+      }
+    }
+  }
+  index.add(first, 0, 1);
+  index.add(second, half, 2);
+  CHECK(index.size() == ROWS);
+
+  std::stringstream file;
+  index.save(file);
+  IVFPQIndex loaded;
+  loaded.load(file);
+  CHECK(loaded.nbits() == nbits);
+  CHECK(loaded.nlist() == NLIST);
+  CHECK(loaded.size() == ROWS);
+
+  Vector query(DIM);
+  int32_t queries = 0, found = 0;
+  for (int64_t i = 0; i < ROWS; i += 10) {
+    for (int64_t j = 0; j < DIM; j++) {
+      query[j] = x.at(i, j);
+    }
+    std::vector<std::pair<float, int32_t>> expected, actual;
+    index.search(query, 10, NLIST, expected);
+    loaded.search(query, 10, NLIST, actual);
+    CHECK(expected.size() == 10);
+    CHECK(expected == actual);
+    for (const auto& result : actual) {
+      found += result.second == i;
+    }
+    queries++;
+  }
+  // A row is scored from its own code, so it is nearly always among the
+  // closest ones to itself.
+  CHECK(found >= 0.9 * queries);
+}
+
+TEST(roundTrip8Bits) {
+  checkRoundTrip(8);
+}
+
+TEST(roundTrip4Bits) {
+  checkRoundTrip(4);
+}
+
+TEST(rejectsOtherBits) {
+  CHECK_THROWS(IVFPQIndex(DIM, NLIST, 2, 6), std::invalid_argument);
+}
+
+}  // namespace
+
+int main() {
+  return test::runAll();
+}
@@ -0,0 +1,144 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "args.h"
+#include "kernels.h"
+#include "matrix.h"
+#include "model.h"
+#include "test.h"
+
+using namespace fasttext;
+
+namespace {
+
+// The kernels of every instruction set the CPU supports.
+std::vector<const kernels::KernelOps*> supportedOps() {
+  std::vector<const kernels::KernelOps*> result = {&kernels::scalarOps()};
+  const kernels::isa best = kernels::detectIsa();
+  if (best >= kernels::isa::sse42) result.push_back(&kernels::sse42Ops());
+  if (best >= kernels::isa::avx2) result.push_back(&kernels::avx2Ops());
+  if (best >= kernels::isa::avx512) result.push_back(&kernels::avx512Ops());
+  return result;
+}
+
+// n values with a NaN in the vector part and one in the scalar tail.
+std::vector<float> withNaN(int64_t n) {
+  std::vector<float> x(n);
+  for (int64_t i = 0; i < n; i++) {
+    x[i] = 0.25f * (i % 7) + 0.1f;
+  }
+  x[3] = std::nanf("");
+  x[n - 1] = std::nanf("");
+  return x;
+}
+
+bool onlyNaNsPropagate(const std::vector<float>& y) {
+  const int64_t n = y.size();
+  for (int64_t i = 0; i < n; i++) {
+    const bool nan = i == 3 || i == n - 1;
+    if (std::isnan(y[i]) != nan) return false;
+  }
+  return true;
+}
+
+// Clamping the input of exp or log must not turn a NaN into a number, or a
+// diverged model would report a finite loss.
+TEST(kernelsPropagateNaN) {
+  const int64_t n = 37;
+  for (const kernels::KernelOps* ops : supportedOps()) {
+    std::vector<float> x = withNaN(n);
+    ops->expShift(x.data(), n, 1.0f);
+    CHECK(onlyNaNsPropagate(x));
+    x = withNaN(n);
+    ops->sigmoid(x.data(), n);
+    CHECK(onlyNaNsPropagate(x));
+    x = withNaN(n);
+    ops->log(x.data(), n);
+    CHECK(onlyNaNsPropagate(x));
+    x = withNaN(n);
+    CHECK(std::isnan(ops->sumExp(x.data(), n - 1, 0.0f)));
+  }
+}
+
+// Updates model on n random examples of three words and one label.
+void train(Model& model, int32_t nwords, int32_t nlabels, float lr,
+           int32_t n) {
+  std::minstd_rand rng(1);
+  std::uniform_int_distribution<int32_t> word(0, nwords - 1);
+  std::uniform_int_distribution<int32_t> label(0, nlabels - 1);
+  for (int32_t i = 0; i < n; i++) {
+    std::vector<int32_t> input = {word(rng), word(rng), word(rng)};
+    model.update(input, label(rng), lr, 1.0);
+  }
+}
+
+// A learning rate this large makes the weights overflow within a few
+// updates; training must stop instead of going on with NaN vectors.
+TEST(divergenceThrows) {
+  const int32_t nwords = 100, nlabels = 50;
+  std::shared_ptr<Args> args = std::make_shared<Args>();
+  args->model = model_name::sup;
+  args->loss = loss_name::ns;
+  args->neg = 15;
+  args->dim = 16;
+  std::shared_ptr<Matrix> wi = std::make_shared<Matrix>(nwords, args->dim);
+  std::shared_ptr<Matrix> wo = std::make_shared<Matrix>(nlabels, args->dim);
+  wi->uniform(1.0 / args->dim);
+  wo->zero();
+  Model model(wi, wo, args, 0);
+  model.setTargetCounts(std::vector<float>(nlabels, 1.0));
+
+  CHECK_THROWS(train(model, nwords, nlabels, 1e6, 10000),
+               std::runtime_error);
+}
+
+// Splitting the softmax across helper threads changes the order of the
+// sums only, so the models trained with and without them stay together.
+TEST(softmaxThreadsMatchOneThread) {
+  const int32_t nwords = 100, nlabels = 3 * 4096;
+  std::vector<std::shared_ptr<Matrix>> outputs;
+  std::vector<float> losses;
+  for (int32_t threads : {1, 3}) {
+    std::shared_ptr<Args> args = std::make_shared<Args>();
+    args->model = model_name::sup;
+    args->loss = loss_name::softmax;
+    args->dim = 16;
+    args->softmaxThread = threads;
+    std::shared_ptr<Matrix> wi = std::make_shared<Matrix>(nwords, args->dim);
+    std::shared_ptr<Matrix> wo = std::make_shared<Matrix>(nlabels, args->dim);
+    wi->uniform(1.0 / args->dim);
+    wo->uniform(1.0 / args->dim);
+    Model model(wi, wo, args, 0);
+    train(model, nwords, nlabels, 0.1, 50);
+    outputs.push_back(wo);
+    losses.push_back(model.getLoss());
+  }
+  CHECK(std::abs(losses[0] - losses[1]) < 1e-4 * losses[0]);
+  float maxDiff = 0.0;
+  for (int64_t i = 0; i < nlabels; i++) {
+    for (int64_t j = 0; j < outputs[0]->cols(); j++) {
+      maxDiff = std::max(
+          maxDiff, std::abs(outputs[0]->at(i, j) - outputs[1]->at(i, j)));
+    }
+  }
+  CHECK(maxDiff < 1e-6);
+}
+
+}  // namespace
+
+int main() {
+  return test::runAll();
+}
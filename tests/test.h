@@ -0,0 +1,91 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+// Minimal checks for the unit tests, which are plain executables run by
+// ctest: a failed check is reported and makes the executable fail, and the
+// remaining checks still run.
+
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace fasttext {
+namespace test {
+
+inline int& failures() {
+  static int count = 0;
+  return count;
+}
+
+inline std::vector<std::pair<std::string, std::function<void()>>>& tests() {
+  static std::vector<std::pair<std::string, std::function<void()>>> list;
+  return list;
+}
+
+struct Register {
+  Register(const std::string& name, std::function<void()> body) {
+    tests().push_back(std::make_pair(name, body));
+  }
+};
+
+inline void fail(const char* file, int line, const std::string& what) {
+  std::cerr << file << ":" << line << ": check failed: " << what << std::endl;
+  failures()++;
+}
+
+// Runs every test and returns the exit status of the executable.
+inline int runAll() {
+  for (const auto& test : tests()) {
+    const int before = failures();
+    try {
+      test.second();
+    } catch (const std::exception& e) {
+      std::cerr << test.first << ": unexpected exception: " << e.what()
+                << std::endl;
+      failures()++;
+    }
+    std::cerr << (failures() == before ? "[  OK  ] " : "[ FAIL ] ")
+              << test.first << std::endl;
+  }
+  return failures() == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+}  // namespace test
+}  // namespace fasttext
+
+// TEST(name) { ... } defines a test that runAll() runs.
+#define TEST(name)                                                             \
+  static void name();                                                          \
+  static ::fasttext::test::Register registered_##name(#name, name);            \
+  static void name()
+
+#define CHECK(condition)                                                       \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      ::fasttext::test::fail(__FILE__, __LINE__, #condition);                  \
+    }                                                                          \
+  } while (0)
+
+#define CHECK_THROWS(statement, type)                                          \
+  do {                                                                         \
+    bool thrown = false;                                                       \
+    try {                                                                      \
+      statement;                                                               \
+    } catch (const type&) {                                                    \
+      thrown = true;                                                           \
+    }                                                                          \
+    if (!thrown) {                                                             \
+      ::fasttext::test::fail(__FILE__, __LINE__, #statement " throws " #type); \
+    }                                                                          \
+  } while (0)
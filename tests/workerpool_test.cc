@@ -0,0 +1,54 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <atomic>
+#include <vector>
+
+#include "test.h"
+#include "workerpool.h"
+
+using namespace fasttext;
+
+namespace {
+
+// Every index runs each task exactly once, and run returns only after all
+// of them are done.
+TEST(runsEveryIndexOnce) {
+  for (int32_t size : {1, 2, 5}) {
+    WorkerPool pool(size);
+    CHECK(pool.size() == size);
+    std::vector<int32_t> counts(size, 0);
+    const int32_t ntasks = 1000;
+    for (int32_t i = 0; i < ntasks; i++) {
+      pool.run([&](int32_t t) { counts[t]++; });
+    }
+    bool ok = true;
+    for (int32_t count : counts) {
+      ok = ok && count == ntasks;
+    }
+    CHECK(ok);
+  }
+}
+
+TEST(tasksDoNotOverlap) {
+  WorkerPool pool(4);
+  std::atomic<int32_t> running(0);
+  std::atomic<bool> overlap(false);
+  for (int32_t i = 0; i < 200; i++) {
+    pool.run([&](int32_t) { running++; });
+    overlap = overlap || running != 4 * (i + 1);
+  }
+  CHECK(!overlap);
+}
+
+}  // namespace
+
+int main() {
+  return test::runAll();
+}